@@ -6,6 +6,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -13,6 +14,10 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -120,6 +125,7 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -128,4 +134,8 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
 }
@@ -21,14 +21,56 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Stop the periodic tick while the CPU is idle.  Controlled by
+   kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* While idle in tickless mode, channel 0 runs a one-shot count of
+   oneshot_cycles instead of the periodic tick, covering the next
+   oneshot_ticks ticks; oneshot_first is the part of it left in
+   the tick that was current when it started.  0 if periodic. */
+static int oneshot_ticks;
+static unsigned oneshot_cycles;
+static unsigned oneshot_first;
+
+/* Idle ticks that passed without an interrupt, to be accounted
+   on the next one, and the cycles of partial ticks lost when
+   restarting the periodic tick. */
+static int64_t lost_ticks;
+static unsigned lost_cycles;
+
+/* Number of timer interrupts the one-shots saved. */
+static int64_t skipped_ticks;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
-/* A list of threads which are sleeping */
-static struct list sleeping_list;
+/* Armed timers are kept in a hierarchical timer wheel, so arming
+   and cancelling a timer is O(1).  Level 0 has a slot for each of
+   the next WHEEL_SIZE ticks, each slot of level L covers
+   WHEEL_SIZE^L ticks.  Whenever level L wraps around, the next slot
+   of level L+1 is cascaded, its timers are moved down to the level
+   matching the time left.  Timers further away than the wheel
+   covers wait in its last level and are cascaded again. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Next tick whose level 0 slot the wheel will run. */
+static int64_t wheel_ticks;
 
 static intr_handler_func timer_interrupt;
+static void wheel_insert (struct timer *);
+static void wheel_run (void);
+static void timer_tick (bool idle);
+static void oneshot_stop (void);
+static timer_func wake_sleeper;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -39,9 +81,13 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  int level, slot;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init (&sleeping_list);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init (&wheel[level][slot]);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -76,7 +122,7 @@ int64_t
 timer_ticks (void) 
 {
   enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
+  int64_t t = ticks + lost_ticks;
   intr_set_level (old_level);
   return t;
 }
@@ -89,29 +135,74 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Initializes timer T to call FUNC (AUX) when it fires. */
+void
+timer_setup (struct timer *t, timer_func *func, void *aux)
+{
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arms timer T to fire at tick EXPIRES, or on the next tick if
+   EXPIRES has passed.  T must not be pending.  May be called from
+   an interrupt handler, including a timer function. */
+void
+timer_add (struct timer *t, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (!t->pending);
+
+  old_level = intr_disable ();
+  t->expires = expires;
+  t->pending = true;
+  wheel_insert (t);
+  intr_set_level (old_level);
+}
+
+/* Disarms timer T.  Returns true if it was pending, false if it
+   has already fired or was never armed. */
+bool
+timer_cancel (struct timer *t)
+{
+  enum intr_level old_level = intr_disable ();
+  bool pending = t->pending;
+
+  if (pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  intr_set_level (old_level);
+  return pending;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
   int64_t start = timer_ticks ();
-  struct thread *t = thread_current ();
-  enum intr_level old_level;
+  struct semaphore sema;
+  struct timer timer;
 
   ASSERT (intr_get_level () == INTR_ON);
 
   if (timer_elapsed (start) > ticks)
     return;
-  
-  /* Set wake up tick and insert the thread to the sleeping list
-  and block the thread should be done atomically. */
-  old_level = intr_disable ();
-  t->wakeup_tick = start + ticks;
-  list_insert_ordered (&sleeping_list, &t->sleeplistelem, 
-                        thread_wakeuptick_less, NULL);
-  /* Block the thread */
-  sema_down (&t->sleepsema);
-  intr_set_level (old_level);  
+
+  sema_init (&sema, 0);
+  timer_setup (&timer, wake_sleeper, &sema);
+  timer_add (&timer, start + ticks);
+  sema_down (&sema);
+}
+
+/* Timer function of timer_sleep(): wakes up the sleeping thread. */
+static void
+wake_sleeper (void *sema)
+{
+  sema_up (sema);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -182,27 +273,137 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" ticks skipped while idle\n", skipped_ticks);
+}
+
+/* Called by the idle thread with interrupts off, right before it
+   halts.  In tickless mode, replaces the periodic tick by a
+   one-shot count up to the next tick that has a timer to run or
+   cascades the timer wheel, so an idle CPU is not woken up by
+   empty ticks.  The 16-bit counter limits the one-shot to a few
+   ticks, so a long idle period takes several of them. */
+void
+timer_idle_enter (void)
+{
+  unsigned first;
+  bool out;
+  int n, max;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0 || lost_ticks != 0)
+    return;
+
+  /* The next interrupt runs tick wheel_ticks, which is FIRST
+     cycles away. */
+  first = pit_read_count (0, &out);
+  if (first == 0 || first > TICK_CYCLES)
+    return;
+  max = 1 + (65535 - first) / TICK_CYCLES;
+  for (n = 1; n < max; n++)
+    {
+      int64_t tick = wheel_ticks + n - 1;
+      if (!list_empty (&wheel[0][tick & WHEEL_MASK])
+          || (tick & WHEEL_MASK) == 0)
+        break;
+    }
+  if (n < 2)
+    return;
+
+  oneshot_ticks = n;
+  oneshot_first = first;
+  oneshot_cycles = first + (n - 1) * TICK_CYCLES;
+  pit_start_oneshot (0, oneshot_cycles);
+}
+
+/* Called with interrupts off when the idle thread gives up the
+   CPU.  If the one-shot has not run out, accounts for the ticks
+   that passed and restarts the periodic tick, so the threads to
+   run get their time slices.  If it did run out, its interrupt is
+   pending and will do that. */
+void
+timer_idle_exit (void)
+{
+  bool out;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+  pit_read_count (0, &out);
+  if (!out)
+    oneshot_stop ();
+}
+
+/* Stops the one-shot count, which has not run out, and restarts
+   the periodic tick.  The whole ticks that passed are added to
+   lost_ticks; the partial tick is carried in lost_cycles. */
+static void
+oneshot_stop (void)
+{
+  unsigned elapsed, total;
+  bool out;
+
+  elapsed = oneshot_cycles - pit_read_count (0, &out);
+  total = (TICK_CYCLES - oneshot_first) + elapsed;
+  lost_ticks += total / TICK_CYCLES;
+  lost_cycles += total % TICK_CYCLES;
+  if (lost_cycles >= TICK_CYCLES)
+    {
+      lost_cycles -= TICK_CYCLES;
+      lost_ticks++;
+    }
+  skipped_ticks += total / TICK_CYCLES;
+
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  oneshot_ticks = 0;
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
-
-  while (!list_empty (&sleeping_list)) 
+  if (oneshot_ticks != 0)
     {
-      struct thread *t = list_entry (list_front (&sleeping_list), 
-                                        struct thread, sleeplistelem);
+      bool out;
 
-      /* No thread waiting to wake up since the sleeping list is ordered. */
-      if (t->wakeup_tick > ticks) 
-        break;
-      list_pop_front(&sleeping_list);
-      /* Unblock the thread. */
-      sema_up(&t->sleepsema);
+      pit_read_count (0, &out);
+      if (out)
+        {
+          /* The one-shot ran out: this interrupt ends its last
+             tick. */
+          lost_ticks += oneshot_ticks - 1;
+          skipped_ticks += oneshot_ticks - 1;
+          pit_configure_channel (0, 2, TIMER_FREQ);
+          oneshot_ticks = 0;
+        }
+      else
+        oneshot_stop ();
+    }
+
+  /* Catch up with the ticks that passed while idle. */
+  while (lost_ticks > 0)
+    {
+      lost_ticks--;
+      timer_tick (true);
     }
+  timer_tick (false);
+}
+
+/* Advances the time by a tick.  IDLE is true for a tick that
+   passed without an interrupt while the CPU was idle. */
+static void
+timer_tick (bool idle)
+{
+  ticks++;
+  if (idle)
+    thread_tick_idle ();
+  else
+    thread_tick ();
+
+  while (wheel_ticks <= ticks)
+    wheel_run ();
   
   if (thread_mlfqs) 
     {
@@ -210,18 +411,18 @@ timer_interrupt (struct intr_frame *args UNUSED)
       enum intr_level old_level = intr_disable ();
 
       /* Recent cpu calculation for the running thread. */
-      if (t->status == THREAD_RUNNING)
+      if (!idle && t->status == THREAD_RUNNING)
         t->recent_cpu = FADDI (t->recent_cpu, 1);
       
-      /* Update system load average and all threads' recent cpu
-      every second. */
+      /* Update system load average and the runnable threads'
+      recent cpu every second. */
       if ((ticks % TIMER_FREQ) == 0)
         {
-          update_sys_load_avg ();
+          update_sys_load_avg (idle);
           update_thread_recent_cpu ();
         }
       
-      /* Update all threads' priority every fourth clock. */
+      /* Update the running thread's priority every fourth clock. */
       if (ticks % 4 == 0)
         update_thread_priority ();
       
@@ -229,6 +430,80 @@ timer_interrupt (struct intr_frame *args UNUSED)
     }
 }
 
+/* Puts pending timer T in the wheel slot for the time it has
+   left.  Interrupts must be off. */
+static void
+wheel_insert (struct timer *t)
+{
+  int64_t expires = t->expires;
+  int64_t delta = expires - wheel_ticks;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0)
+    {
+      /* Already expired, fire on the next run. */
+      expires = wheel_ticks;
+      delta = 0;
+    }
+  else if (delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+    {
+      /* Beyond the wheel, wait in its last level. */
+      delta = ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+      expires = wheel_ticks + delta;
+    }
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Runs the timers of tick wheel_ticks and advances the wheel by a
+   tick.  Called from the timer interrupt. */
+static void
+wheel_run (void)
+{
+  struct list *slot = &wheel[0][wheel_ticks & WHEEL_MASK];
+  struct list expired;
+  int level;
+
+  /* Cascade the next slot of each level that wrapped around. */
+  for (level = 1; (wheel_ticks >> (WHEEL_BITS * (level - 1)) & WHEEL_MASK) == 0
+                  && level < WHEEL_LEVELS; level++)
+    {
+      struct list *upper = &wheel[level][(wheel_ticks >> (WHEEL_BITS * level))
+                                         & WHEEL_MASK];
+      struct list moved;
+
+      list_init (&moved);
+      while (!list_empty (upper))
+        list_push_back (&moved, list_pop_front (upper));
+      while (!list_empty (&moved))
+        wheel_insert (list_entry (list_pop_front (&moved),
+                                  struct timer, elem));
+    }
+
+  /* A timer function may arm its timer again, for the next tick at
+     the earliest. */
+  list_init (&expired);
+  while (!list_empty (slot))
+    list_push_back (&expired, list_pop_front (slot));
+  wheel_ticks++;
+
+  while (!list_empty (&expired))
+    {
+      struct timer *t = list_entry (list_pop_front (&expired),
+                                    struct timer, elem);
+      t->pending = false;
+      t->func (t->aux);
+    }
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -1,18 +1,40 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Stop the periodic tick while idle ("-tickless" option). */
+extern bool timer_tickless;
+
+/* A kernel timer.  Once armed with timer_add(), FUNC (AUX) is
+   called from the timer interrupt at tick EXPIRES. */
+typedef void timer_func (void *aux);
+struct timer
+  {
+    int64_t expires;            /* Tick to fire at. */
+    timer_func *func;           /* Function to call. */
+    void *aux;                  /* Its argument. */
+    bool pending;               /* Armed and not fired yet. */
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* Kernel timers. */
+void timer_setup (struct timer *, timer_func *, void *aux);
+void timer_add (struct timer *, int64_t expires);
+bool timer_cancel (struct timer *);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -24,6 +46,10 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle, called by the idle thread. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
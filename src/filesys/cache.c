@@ -136,6 +136,30 @@ cache_block_write (block_sector_t sector, const void *buffer, int sector_ofs, in
   lock_release (&cache_lock);
 }
 
+/* Drop SECTOR from the cache, writing it back first if WRITE_BACK
+   and it is dirty.  Used by the page cache, which keeps file data
+   itself and reads and writes it around this cache. */
+void 
+cache_invalidate (block_sector_t sector, bool write_back)
+{
+  struct cache_entry *entry;
+  lock_acquire (&cache_lock);
+  struct hash_elem *elem = get_cache_elem (sector);
+
+  if (elem)
+    {
+      entry = hash_entry (elem, struct cache_entry, hashelem);
+      list_remove (&entry->listelem);
+      hash_delete (&cache_hash, &entry->hashelem);
+      if (write_back && entry->is_dirty)
+        block_write (fs_device, entry->cache_sector, entry->cache_block);
+      free (entry->cache_block);
+      free (entry);
+    }
+
+  lock_release (&cache_lock);
+}
+
 static void 
 update_lru (struct cache_entry *entry) 
 {
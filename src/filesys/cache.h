@@ -1,6 +1,7 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <stdbool.h>
 #include "devices/block.h"
 
 void cache_init (void);
@@ -11,5 +12,6 @@ void cache_block_read (block_sector_t sector, void *buffer,
                                 int sector_ofs, int size);
 void cache_block_write (block_sector_t sector, const void *buffer, 
                                 int sector_ofs, int size);
+void cache_invalidate (block_sector_t sector, bool write_back);
 
 #endif
\ No newline at end of file
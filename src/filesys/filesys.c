@@ -5,6 +5,7 @@
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/pagecache.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "threads/thread.h"
@@ -92,6 +93,7 @@ filesys_init (bool format)
   inode_init ();
   free_map_init ();
   cache_init ();
+  pagecache_init ();
 
   if (format) 
     do_format ();
@@ -105,6 +107,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  pagecache_flush ();
   cache_clear ();
 }
 
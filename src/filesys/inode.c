@@ -6,8 +6,10 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/pagecache.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -253,6 +255,9 @@ inode_close (struct inode *inode)
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
  
+      /* Write back or discard its pages. */
+      pagecache_drop (inode, !inode->removed);
+
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
@@ -300,6 +305,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  /* File data lives in the page cache. */
+  if (inode_is_file (inode))
+    {
+      if (offset >= inode_length (inode) || size <= 0)
+        return 0;
+      if (size > inode_length (inode) - offset)
+        size = inode_length (inode) - offset;
+      return pagecache_read (inode, buffer, size, offset);
+    }
+
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -353,6 +368,14 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       cache_block_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
     }
 
+  if (inode_is_file (inode))
+    {
+      if (size <= 0)
+        return 0;
+      pagecache_write (inode, buffer, size, offset);
+      return size;
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -380,6 +403,54 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Reads page IDX of file INODE into PAGE for the page cache, straight
+   from disk.  The part of the page past the end of the file is
+   zeroed. */
+void
+inode_read_page (struct inode *inode, size_t idx, void *page)
+{
+  uint8_t *buffer = page;
+  off_t pos = idx * PGSIZE;
+  int i;
+
+  for (i = 0; i < PGSIZE / BLOCK_SECTOR_SIZE; i++, pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector == (block_sector_t) -1)
+        {
+          memset (buffer + i * BLOCK_SECTOR_SIZE, 0,
+                  PGSIZE - i * BLOCK_SECTOR_SIZE);
+          break;
+        }
+
+      /* The buffer cache may still hold a newer copy, e.g. the zeros
+         written when the file grew. */
+      cache_invalidate (sector, true);
+      block_read (fs_device, sector, buffer + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Writes PAGE back as page IDX of file INODE, straight to disk.
+   Sectors past the end of the file are skipped. */
+void
+inode_write_page (struct inode *inode, size_t idx, const void *page)
+{
+  const uint8_t *buffer = page;
+  off_t pos = idx * PGSIZE;
+  int i;
+
+  for (i = 0; i < PGSIZE / BLOCK_SECTOR_SIZE; i++, pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector == (block_sector_t) -1)
+        break;
+
+      /* Do not let a stale copy in the buffer cache overwrite it. */
+      cache_invalidate (sector, false);
+      block_write (fs_device, sector, buffer + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -2,6 +2,7 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
@@ -18,6 +19,8 @@ bool inode_is_removed (struct inode *);
 bool inode_is_file (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_read_page (struct inode *, size_t idx, void *page);
+void inode_write_page (struct inode *, size_t idx, const void *page);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -0,0 +1,325 @@
+#include <string.h>
+#include "filesys/pagecache.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "list.h"
+#include "hash.h"
+
+/* The page cache keeps the data of regular files a page at a time,
+   key=(inode, page index).  File data is read and written around
+   the sector buffer cache, which is left to directories and inode
+   metadata, so a file page is cached once.  read() and write()
+   copy from and to it, and memory mapped files map its pages
+   straight into the processes, see pagecache_map().
+
+   A mapped page is not evicted until every process unmapped it.
+   At most PCACHE_MAP_MAX pages are mapped at once, so there is
+   always a page left to evict. */
+#define PCACHE_SIZE 32
+#define PCACHE_MAP_MAX (PCACHE_SIZE / 2)
+
+struct pcache_page
+  {
+    struct inode *inode;
+    size_t idx;                 /* Page index within the file. */
+    void *kpage;
+    bool dirty;
+    unsigned map_cnt;           /* Number of processes mapping it. */
+    struct hash_elem hashelem;
+    struct list_elem listelem;
+  };
+
+static struct lock pcache_lock;
+static struct list pcache_list;     /* LRU order, oldest first. */
+static struct hash pcache_hash;
+static size_t pcache_mapped_cnt;    /* Pages with a nonzero map_cnt. */
+
+static struct pcache_page *pcache_get (struct inode *inode, size_t idx,
+                                       bool fill);
+static struct pcache_page *pcache_find (struct inode *inode, size_t idx);
+static void pcache_write_back (struct pcache_page *page);
+static void pcache_release (struct pcache_page *page, bool write_back);
+
+static unsigned
+pcache_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct pcache_page *page = hash_entry (e, struct pcache_page, hashelem);
+  return hash_bytes (&page->inode, sizeof page->inode) ^ hash_int (page->idx);
+}
+
+static bool
+pcache_less_func (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  struct pcache_page *p1 = hash_entry (a, struct pcache_page, hashelem);
+  struct pcache_page *p2 = hash_entry (b, struct pcache_page, hashelem);
+  if (p1->inode != p2->inode)
+    return p1->inode < p2->inode;
+  return p1->idx < p2->idx;
+}
+
+void
+pagecache_init (void)
+{
+  lock_init (&pcache_lock);
+  list_init (&pcache_list);
+  hash_init (&pcache_hash, pcache_hash_func, pcache_less_func, NULL);
+}
+
+/* Write every dirty page back to disk. */
+void
+pagecache_flush (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&pcache_lock);
+  for (e = list_begin (&pcache_list); e != list_end (&pcache_list);
+       e = list_next (e))
+    {
+      struct pcache_page *page = list_entry (e, struct pcache_page, listelem);
+      pcache_write_back (page);
+    }
+  lock_release (&pcache_lock);
+}
+
+/* Reads SIZE bytes at OFFSET of INODE into BUFFER.  The range must
+   lie within the file.  Returns SIZE. */
+off_t
+pagecache_read (struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  lock_acquire (&pcache_lock);
+  while (size > 0)
+    {
+      size_t page_ofs = offset % PGSIZE;
+      off_t chunk_size = PGSIZE - page_ofs;
+      struct pcache_page *page;
+
+      if (chunk_size > size)
+        chunk_size = size;
+
+      page = pcache_get (inode, offset / PGSIZE, true);
+      memcpy (buffer + bytes_read, (uint8_t *) page->kpage + page_ofs,
+              chunk_size);
+
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  lock_release (&pcache_lock);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET of INODE.  The file must
+   already be long enough.  A page written as a whole is not read
+   from disk first. */
+void
+pagecache_write (struct inode *inode, const void *buffer_, off_t size,
+                 off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+
+  lock_acquire (&pcache_lock);
+  while (size > 0)
+    {
+      size_t page_ofs = offset % PGSIZE;
+      off_t chunk_size = PGSIZE - page_ofs;
+      struct pcache_page *page;
+
+      if (chunk_size > size)
+        chunk_size = size;
+
+      page = pcache_get (inode, offset / PGSIZE, chunk_size < PGSIZE);
+      memcpy ((uint8_t *) page->kpage + page_ofs, buffer, chunk_size);
+      page->dirty = true;
+
+      size -= chunk_size;
+      offset += chunk_size;
+      buffer += chunk_size;
+    }
+  lock_release (&pcache_lock);
+}
+
+/* Returns the page holding page IDX of INODE, for a process to map
+   it, or NULL if too many pages are mapped already: the VM then
+   unmaps a cold one and tries again, see frame_get_cached().  The
+   page stays in the cache until the process calls
+   pagecache_unmap(). */
+void *
+pagecache_map (struct inode *inode, size_t idx)
+{
+  struct pcache_page *page;
+  void *kpage = NULL;
+
+  lock_acquire (&pcache_lock);
+  page = pcache_get (inode, idx, true);
+  if (page->map_cnt > 0 || pcache_mapped_cnt < PCACHE_MAP_MAX)
+    {
+      if (page->map_cnt++ == 0)
+        pcache_mapped_cnt++;
+      kpage = page->kpage;
+    }
+  lock_release (&pcache_lock);
+
+  return kpage;
+}
+
+/* Drops a mapping of page IDX of INODE, taken by pagecache_map().
+   DIRTY tells if the process wrote to it. */
+void
+pagecache_unmap (struct inode *inode, size_t idx, bool dirty)
+{
+  struct pcache_page *page;
+
+  lock_acquire (&pcache_lock);
+  page = pcache_find (inode, idx);
+  ASSERT (page != NULL && page->map_cnt > 0);
+  if (dirty)
+    page->dirty = true;
+  if (--page->map_cnt == 0)
+    pcache_mapped_cnt--;
+  lock_release (&pcache_lock);
+}
+
+/* Marks page IDX of INODE, which a process maps and wrote to,
+   dirty, and writes it back now if WRITE_BACK. */
+void
+pagecache_sync (struct inode *inode, size_t idx, bool dirty,
+                bool write_back)
+{
+  struct pcache_page *page;
+
+  lock_acquire (&pcache_lock);
+  page = pcache_find (inode, idx);
+  ASSERT (page != NULL && page->map_cnt > 0);
+  if (dirty)
+    page->dirty = true;
+  if (write_back)
+    pcache_write_back (page);
+  lock_release (&pcache_lock);
+}
+
+/* Remove the pages of INODE from the cache, writing the dirty ones
+   back if WRITE_BACK.  Called when INODE is closed for the last
+   time, a removed inode is not written back. */
+void
+pagecache_drop (struct inode *inode, bool write_back)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&pcache_lock);
+  for (e = list_begin (&pcache_list); e != list_end (&pcache_list); e = next)
+    {
+      struct pcache_page *page = list_entry (e, struct pcache_page, listelem);
+      next = list_next (e);
+      if (page->inode == inode)
+        {
+          /* A mapping keeps the file open. */
+          ASSERT (page->map_cnt == 0);
+          pcache_release (page, write_back);
+        }
+    }
+  lock_release (&pcache_lock);
+}
+
+/* Find page IDX of INODE and make it the most recently used, or put
+   it in the cache, reading it from disk if FILL.  pcache_lock must
+   be held. */
+static struct pcache_page *
+pcache_get (struct inode *inode, size_t idx, bool fill)
+{
+  struct pcache_page *page;
+
+  ASSERT (lock_held_by_current_thread (&pcache_lock));
+  page = pcache_find (inode, idx);
+  if (page)
+    {
+      list_remove (&page->listelem);
+      list_push_back (&pcache_list, &page->listelem);
+      return page;
+    }
+
+  page = malloc (sizeof *page);
+  ASSERT (page);
+  page->kpage = NULL;
+  if (hash_size (&pcache_hash) < PCACHE_SIZE)
+    page->kpage = palloc_get_page (hash_size (&pcache_hash)
+                                   == pcache_mapped_cnt ? PAL_ASSERT : 0);
+  if (!page->kpage)
+    {
+      /* Reuse the least recently used page that is not mapped.  There
+         is one: the cache is full, or some page is not mapped. */
+      struct list_elem *e = list_begin (&pcache_list);
+      struct pcache_page *victim;
+
+      while ((victim = list_entry (e, struct pcache_page, listelem))->map_cnt)
+        e = list_next (e);
+      pcache_write_back (victim);
+      list_remove (&victim->listelem);
+      hash_delete (&pcache_hash, &victim->hashelem);
+      page->kpage = victim->kpage;
+      free (victim);
+    }
+
+  page->inode = inode;
+  page->idx = idx;
+  page->dirty = false;
+  page->map_cnt = 0;
+  if (fill)
+    inode_read_page (inode, idx, page->kpage);
+  else
+    memset (page->kpage, 0, PGSIZE);
+  hash_insert (&pcache_hash, &page->hashelem);
+  list_push_back (&pcache_list, &page->listelem);
+  return page;
+}
+
+/* Returns page IDX of INODE, or NULL if it is not in the cache.
+   pcache_lock must be held. */
+static struct pcache_page *
+pcache_find (struct inode *inode, size_t idx)
+{
+  struct pcache_page tmp;
+  struct hash_elem *e;
+
+  tmp.inode = inode;
+  tmp.idx = idx;
+  e = hash_find (&pcache_hash, &tmp.hashelem);
+  return e != NULL ? hash_entry (e, struct pcache_page, hashelem) : NULL;
+}
+
+/* Writes PAGE back if it is dirty.  What a process mapping the
+   last page of the file wrote past its end is cleared rather than
+   written, as if the file had been read there.  pcache_lock must
+   be held. */
+static void
+pcache_write_back (struct pcache_page *page)
+{
+  off_t length = inode_length (page->inode) - (off_t) (page->idx * PGSIZE);
+
+  if (!page->dirty)
+    return;
+  if (length < PGSIZE)
+    memset ((uint8_t *) page->kpage + length, 0, PGSIZE - length);
+  page->dirty = false;
+  inode_write_page (page->inode, page->idx, page->kpage);
+}
+
+/* Remove PAGE from the cache and free it.  pcache_lock must be
+   held. */
+static void
+pcache_release (struct pcache_page *page, bool write_back)
+{
+  if (write_back)
+    pcache_write_back (page);
+  list_remove (&page->listelem);
+  hash_delete (&pcache_hash, &page->hashelem);
+  palloc_free_page (page->kpage);
+  free (page);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_PAGECACHE_H
+#define FILESYS_PAGECACHE_H
+
+#include "filesys/off_t.h"
+#include "filesys/inode.h"
+
+void pagecache_init (void);
+void pagecache_flush (void);
+
+off_t pagecache_read (struct inode *inode, void *buffer, off_t size,
+                      off_t offset);
+void pagecache_write (struct inode *inode, const void *buffer, off_t size,
+                      off_t offset);
+void pagecache_drop (struct inode *inode, bool write_back);
+
+void *pagecache_map (struct inode *inode, size_t idx);
+void pagecache_unmap (struct inode *inode, size_t idx, bool dirty);
+void pagecache_sync (struct inode *inode, size_t idx, bool dirty,
+                     bool write_back);
+
+#endif
@@ -0,0 +1,176 @@
+/* Pairing heap.
+
+   The heap is a tree in which no element is less than its
+   parent.  The children of an element are kept in a doubly
+   linked list, starting at its `child' member; the `prev' member
+   of the first child points to the parent.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes heap H as an empty heap that compares its elements
+   using LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) 
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h) 
+{
+  return h->root == NULL;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) 
+{
+  return h->elem_cnt;
+}
+
+/* Inserts E into H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e) 
+{
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->elem_cnt++;
+}
+
+/* Returns the top element of H, which must not be empty. */
+struct heap_elem *
+heap_top (const struct heap *h) 
+{
+  ASSERT (!heap_empty (h));
+  return h->root;
+}
+
+/* Removes the top element of H, which must not be empty, and
+   returns it. */
+struct heap_elem *
+heap_pop (struct heap *h) 
+{
+  struct heap_elem *top = heap_top (h);
+
+  heap_remove (h, top);
+  return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) 
+{
+  struct heap_elem *sub;
+
+  ASSERT (!heap_empty (h));
+
+  /* Cut E out of its parent's children. */
+  if (e != h->root)
+    {
+      if (e->prev->child == e)
+        e->prev->child = e->next;
+      else
+        e->prev->next = e->next;
+      if (e->next != NULL)
+        e->next->prev = e->prev;
+    }
+
+  /* Put its own children back. */
+  sub = merge_pairs (h, e->child);
+  if (e == h->root)
+    h->root = sub;
+  else
+    h->root = meld (h, h->root, sub);
+  h->elem_cnt--;
+
+  e->child = e->next = e->prev = NULL;
+}
+
+/* Moves E, which must be in H, to its place in H after its key
+   changed. */
+void
+heap_rekey (struct heap *h, struct heap_elem *e) 
+{
+  heap_remove (h, e);
+  heap_insert (h, e);
+}
+
+/* Joins the trees rooted at A and B, either of which may be
+   null, and returns the root of the result.  A and B must have
+   no siblings. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) 
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* B becomes the first child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Joins the list of sibling trees starting at FIRST into one
+   tree and returns its root, or a null pointer if FIRST is null.
+   Pairs of trees are joined from left to right, then the pairs
+   are joined from right to left. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) 
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+      a = meld (h, a, b);
+      a->next = pairs;
+      pairs = a;
+    }
+
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+
+      pairs->next = NULL;
+      root = meld (h, pairs, root);
+      pairs = next;
+    }
+  if (root != NULL)
+    root->prev = NULL;
+  return root;
+}
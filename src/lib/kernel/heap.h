@@ -0,0 +1,68 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   A pairing heap.  Like the linked list, it does not allocate
+   memory: each structure that is a potential heap element must
+   embed a struct heap_elem member, and heap_entry converts a
+   struct heap_elem back to the structure that contains it.
+   Refer to lib/kernel/list.h for a detailed explanation.
+
+   Elements are ordered by a less function given to heap_init().
+   The top of the heap is an element that no other element is
+   less than.  Inserting an element and taking the top are O(1)
+   and amortized O(log n), respectively.  An element can be
+   removed from anywhere in the heap, and if its key changes,
+   heap_rekey() moves it to its new place. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem 
+  {
+    struct heap_elem *child;    /* First child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->next     \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap 
+  {
+    struct heap_elem *root;     /* Top element, or NULL. */
+    size_t elem_cnt;            /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+/* Heap properties. */
+bool heap_empty (const struct heap *);
+size_t heap_size (const struct heap *);
+
+/* Heap insertion and removal. */
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (const struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_rekey (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
@@ -182,3 +182,15 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+msync (mapid_t mapid, int flags)
+{
+  return syscall2 (SYS_MSYNC, mapid, flags);
+}
@@ -12,6 +12,10 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Flags for msync(). */
+#define MS_ASYNC 1              /* Schedule the write back. */
+#define MS_SYNC 4               /* Write back before returning. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -45,4 +49,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+int msync (mapid_t, int flags);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,65 @@
+/* Arms kernel timers at different ticks, in reverse order, and
+   cancels one of them.  The others must fire in order of their
+   expiry, each at its own tick, including one that is re-armed
+   from its timer function and one far enough away to be cascaded
+   down the timer wheel. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TIMER_CNT 4
+
+static struct timer timers[TIMER_CNT];
+static int fired[TIMER_CNT + 1];
+static int fired_cnt;
+static bool rearmed;
+static struct semaphore done;
+
+static void
+timer_fired (void *aux) 
+{
+  int id = (int) aux;
+
+  fired[fired_cnt++] = id;
+  if (id == 1 && !rearmed)
+    {
+      rearmed = true;
+      timer_add (&timers[1], timers[1].expires + 5);
+    }
+  else if (id == TIMER_CNT - 1)
+    sema_up (&done);
+}
+
+void
+test_alarm_timer (void) 
+{
+  int64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  for (i = 0; i < TIMER_CNT; i++)
+    timer_setup (&timers[i], timer_fired, (void *) i);
+
+  start = timer_ticks ();
+  timer_add (&timers[3], start + 150);
+  timer_add (&timers[2], start + 20);
+  timer_add (&timers[1], start + 10);
+  timer_add (&timers[0], start + 12);
+
+  if (!timer_cancel (&timers[0]))
+    fail ("cancelling a pending timer failed");
+  if (timer_cancel (&timers[0]))
+    fail ("cancelling a cancelled timer succeeded");
+
+  sema_down (&done);
+
+  for (i = 0; i < fired_cnt; i++)
+    msg ("timer %d fired", fired[i]);
+  if (timer_ticks () - start < 150)
+    fail ("last timer fired early");
+  pass ();
+}
@@ -0,0 +1,92 @@
+/* Checks the work queue: queued work runs in a worker thread,
+   queueing pending work again is refused, delayed work runs no
+   sooner than its delay, and a bottom half raised from a timer
+   function runs on the interrupt's return, with interrupts on. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define DELAY 10
+
+static struct semaphore done;
+static struct work work;
+static struct delayed_work delayed;
+static struct work bottom_half;
+static struct timer timer;
+
+static struct thread *main_thread;
+static bool in_thread;
+static int64_t delayed_ticks;
+static bool bh_intr_on, bh_intr_context;
+
+static void
+queued_func (void *aux UNUSED) 
+{
+  in_thread = !intr_context () && thread_current () != main_thread;
+  sema_up (&done);
+}
+
+static void
+delayed_func (void *start) 
+{
+  delayed_ticks = timer_elapsed (*(int64_t *) start);
+  sema_up (&done);
+}
+
+static void
+bottom_half_func (void *aux UNUSED) 
+{
+  bh_intr_on = intr_get_level () == INTR_ON;
+  bh_intr_context = intr_context ();
+  sema_up (&done);
+}
+
+static void
+raise_bottom_half (void *aux UNUSED) 
+{
+  softirq_raise (&bottom_half);
+}
+
+void
+test_alarm_workqueue (void) 
+{
+  enum intr_level old_level;
+  int64_t start;
+
+  sema_init (&done, 0);
+  main_thread = thread_current ();
+
+  /* Work. */
+  work_init (&work, queued_func, NULL);
+  old_level = intr_disable ();
+  if (!work_queue (&work))
+    fail ("work not queued");
+  if (work_queue (&work))
+    fail ("pending work queued twice");
+  intr_set_level (old_level);
+  sema_down (&done);
+  msg ("work ran%s", in_thread ? " in a thread" : "");
+
+  /* Delayed work. */
+  start = timer_ticks ();
+  delayed_work_init (&delayed, delayed_func, &start);
+  work_queue_delayed (&delayed, DELAY);
+  sema_down (&done);
+  if (delayed_ticks < DELAY)
+    fail ("delayed work ran after %lld ticks", delayed_ticks);
+  msg ("delayed work ran");
+
+  /* Bottom half. */
+  work_init (&bottom_half, bottom_half_func, NULL);
+  timer_setup (&timer, raise_bottom_half, NULL);
+  timer_add (&timer, timer_ticks () + 1);
+  sema_down (&done);
+  msg ("bottom half ran%s%s", bh_intr_on ? " with interrupts on" : "",
+       bh_intr_context ? " in interrupt context" : "");
+  pass ();
+}
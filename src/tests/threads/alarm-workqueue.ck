@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-workqueue) begin
+(alarm-workqueue) work ran in a thread
+(alarm-workqueue) delayed work ran
+(alarm-workqueue) bottom half ran with interrupts on in interrupt context
+(alarm-workqueue) PASS
+(alarm-workqueue) end
+EOF
+pass;
@@ -0,0 +1,127 @@
+/* Runs two periodic deadline threads while threads of the
+   highest priority keep the CPU busy.  Checks that admission
+   control refuses more CPU than the deadline class may get, that
+   no deadline is missed, and that each job starts within a tick
+   or two of the start of its period, however loaded the CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TASK_CNT 2
+#define HOG_CNT 3
+#define JOB_CNT 10
+#define MAX_LATENCY 2
+
+struct task
+  {
+    int64_t runtime, period, deadline;  /* Deadline parameters. */
+    bool admitted;                      /* Admitted to the class? */
+    int misses;                         /* Deadlines missed. */
+    int64_t max_latency;                /* Latest start of a job. */
+  };
+
+static struct task tasks[TASK_CNT] =
+  {
+    {2, 10, 10, false, 0, 0},
+    {3, 20, 15, false, 0, 0},
+  };
+
+static struct semaphore admitted, done;
+static volatile bool stop;
+
+static void
+task_thread (void *task_) 
+{
+  struct task *task = task_;
+  int64_t start = timer_ticks ();
+  int i;
+
+  task->admitted = thread_set_deadline (task->runtime, task->period,
+                                        task->deadline);
+  sema_up (&admitted);
+  if (!task->admitted)
+    {
+      sema_up (&done);
+      return;
+    }
+
+  for (i = 1; i <= JOB_CNT; i++) 
+    {
+      int64_t now;
+
+      thread_wait_period ();
+      now = timer_ticks ();
+      if (now - (start + i * task->period) > task->max_latency)
+        task->max_latency = now - (start + i * task->period);
+
+      /* Use up to a tick of CPU. */
+      while (timer_ticks () == now)
+        continue;
+    }
+  task->misses = thread_get_deadline_misses ();
+  thread_clear_deadline ();
+  sema_up (&done);
+}
+
+static void
+hog_thread (void *aux UNUSED) 
+{
+  while (!stop)
+    continue;
+  sema_up (&done);
+}
+
+void
+test_edf_periodic (void) 
+{
+  char name[16];
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&admitted, 0);
+  sema_init (&done, 0);
+  thread_set_priority (PRI_MAX);
+
+  for (i = 0; i < HOG_CNT; i++) 
+    {
+      snprintf (name, sizeof name, "hog %d", i);
+      thread_create (name, PRI_MAX, hog_thread, NULL);
+    }
+  for (i = 0; i < TASK_CNT; i++) 
+    {
+      snprintf (name, sizeof name, "task %d", i);
+      thread_create (name, PRI_MAX, task_thread, &tasks[i]);
+    }
+  for (i = 0; i < TASK_CNT; i++)
+    sema_down (&admitted);
+
+  if (thread_set_deadline (6, 10, 10))
+    fail ("more than the CPU admitted to the deadline class");
+  msg ("over-admission refused");
+
+  for (i = 0; i < TASK_CNT; i++)
+    sema_down (&done);
+  stop = true;
+  for (i = 0; i < HOG_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < TASK_CNT; i++) 
+    {
+      struct task *task = &tasks[i];
+
+      if (!task->admitted)
+        fail ("task %d not admitted", i);
+      if (task->misses != 0)
+        fail ("task %d missed %d deadlines", i, task->misses);
+      if (task->max_latency > MAX_LATENCY)
+        fail ("task %d started %lld ticks late", i, task->max_latency);
+      msg ("task %d: %d jobs, no deadline missed", i, JOB_CNT);
+    }
+  pass ();
+}
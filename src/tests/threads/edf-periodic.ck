@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-periodic) begin
+(edf-periodic) over-admission refused
+(edf-periodic) task 0: 10 jobs, no deadline missed
+(edf-periodic) task 1: 10 jobs, no deadline missed
+(edf-periodic) PASS
+(edf-periodic) end
+EOF
+pass;
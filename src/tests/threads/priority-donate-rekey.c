@@ -0,0 +1,105 @@
+/* Low-priority main thread L acquires lock A.  Thread M1 acquires
+   lock B then blocks on acquiring lock A, and thread M2 of higher
+   priority blocks on lock A too.  High-priority thread H then
+   blocks on lock B, so M1 passes M2 among the waiters for A and
+   H's priority reaches L through M1.
+
+   When L releases A, M1 gets it ahead of M2.  M1 keeps the
+   priority M2 donates to it through A once it releases B and H's
+   donation ends. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct locks 
+  {
+    struct lock *a;
+    struct lock *b;
+  };
+
+static thread_func m1_thread_func;
+static thread_func m2_thread_func;
+static thread_func high_thread_func;
+
+void
+test_priority_donate_rekey (void) 
+{
+  struct lock a, b;
+  struct locks locks;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  lock_init (&a);
+  lock_init (&b);
+
+  lock_acquire (&a);
+
+  locks.a = &a;
+  locks.b = &b;
+  thread_create ("m1", PRI_DEFAULT + 1, m1_thread_func, &locks);
+  thread_yield ();
+  msg ("Low thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+
+  thread_create ("m2", PRI_DEFAULT + 2, m2_thread_func, &a);
+  thread_yield ();
+  msg ("Low thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+
+  thread_create ("high", PRI_DEFAULT + 3, high_thread_func, &b);
+  thread_yield ();
+  msg ("Low thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+
+  lock_release (&a);
+  msg ("Low thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+m1_thread_func (void *locks_) 
+{
+  struct locks *locks = locks_;
+
+  lock_acquire (locks->b);
+  lock_acquire (locks->a);
+
+  msg ("M1 thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+
+  lock_release (locks->b);
+  msg ("M1 thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+
+  lock_release (locks->a);
+  msg ("M1 thread finished.");
+}
+
+static void
+m2_thread_func (void *lock_) 
+{
+  struct lock *lock = lock_;
+
+  lock_acquire (lock);
+  msg ("M2 thread got the lock.");
+  lock_release (lock);
+  msg ("M2 thread finished.");
+}
+
+static void
+high_thread_func (void *lock_) 
+{
+  struct lock *lock = lock_;
+
+  lock_acquire (lock);
+  msg ("High thread got the lock.");
+  lock_release (lock);
+  msg ("High thread finished.");
+}
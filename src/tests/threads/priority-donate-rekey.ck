@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-rekey) begin
+(priority-donate-rekey) Low thread should have priority 32.  Actual priority: 32.
+(priority-donate-rekey) Low thread should have priority 33.  Actual priority: 33.
+(priority-donate-rekey) Low thread should have priority 34.  Actual priority: 34.
+(priority-donate-rekey) M1 thread should have priority 34.  Actual priority: 34.
+(priority-donate-rekey) High thread got the lock.
+(priority-donate-rekey) High thread finished.
+(priority-donate-rekey) M1 thread should have priority 33.  Actual priority: 33.
+(priority-donate-rekey) M2 thread got the lock.
+(priority-donate-rekey) M2 thread finished.
+(priority-donate-rekey) M1 thread finished.
+(priority-donate-rekey) Low thread should have priority 31.  Actual priority: 31.
+(priority-donate-rekey) end
+EOF
+pass;
@@ -0,0 +1,69 @@
+/* The main thread holds an rwlock for reading.  A higher-priority
+   writer blocks waiting for it to leave, donating its priority
+   to the main thread, and a still higher-priority reader waiting
+   behind the writer donates to both.  A medium-priority thread
+   created afterward must not run before the writer and the
+   reader are done. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread_func;
+static thread_func reader_thread_func;
+static thread_func medium_thread_func;
+
+void
+test_priority_donate_rwlock (void) 
+{
+  struct rwlock rwlock;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock);
+  rwlock_acquire_read (&rwlock);
+  thread_create ("writer", PRI_DEFAULT + 2, writer_thread_func, &rwlock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  thread_create ("reader", PRI_DEFAULT + 3, reader_thread_func, &rwlock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+  thread_create ("medium", PRI_DEFAULT + 1, medium_thread_func, NULL);
+  rwlock_release_read (&rwlock);
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+writer_thread_func (void *rwlock_) 
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_write (rwlock);
+  msg ("writer: got the lock");
+  rwlock_release_write (rwlock);
+  msg ("writer: done");
+}
+
+static void
+reader_thread_func (void *rwlock_) 
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_read (rwlock);
+  msg ("reader: got the lock");
+  rwlock_release_read (rwlock);
+  msg ("reader: done");
+}
+
+static void
+medium_thread_func (void *aux UNUSED) 
+{
+  msg ("medium: done");
+}
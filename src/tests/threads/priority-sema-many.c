@@ -0,0 +1,85 @@
+/* Measures the cost of waking up the highest-priority thread of
+   200 waiting on a semaphore, and checks that they wake up in
+   order of priority, first come, first served within a priority.
+   The waiters are kept in a priority heap, so a wake-up should
+   not cost time linear in the number of waiters. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define WAITER_CNT 200
+#define ROUND_CNT 50
+
+static thread_func waiter_thread;
+
+static struct semaphore sema;
+
+/* Waiters in the order they woke up. */
+static int woken[WAITER_CNT];
+static int woken_cnt;
+
+/* Priority of waiter I. */
+static int
+waiter_priority (int i)
+{
+  return PRI_DEFAULT + 1 + i * 7 % 20;
+}
+
+void
+test_priority_sema_many (void) 
+{
+  int64_t ticks = 0;
+  int round, i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      int64_t start;
+
+      /* Each waiter runs and blocks as soon as it is created. */
+      woken_cnt = 0;
+      for (i = 0; i < WAITER_CNT; i++)
+        {
+          char name[16];
+          snprintf (name, sizeof name, "w%d", i);
+          if (thread_create (name, waiter_priority (i), waiter_thread,
+                             (void *) i) == TID_ERROR)
+            fail ("creating waiter %d failed", i);
+        }
+
+      /* Each wake-up switches to the waiter, which exits. */
+      start = timer_ticks ();
+      for (i = 0; i < WAITER_CNT; i++)
+        sema_up (&sema);
+      ticks += timer_elapsed (start);
+
+      if (woken_cnt != WAITER_CNT)
+        fail ("%d of %d waiters woke up", woken_cnt, WAITER_CNT);
+      for (i = 1; i < WAITER_CNT; i++)
+        {
+          int prev = woken[i - 1], cur = woken[i];
+          if (waiter_priority (prev) < waiter_priority (cur)
+              || (waiter_priority (prev) == waiter_priority (cur)
+                  && prev > cur))
+            fail ("waiter %d woke up before waiter %d", prev, cur);
+        }
+    }
+
+  msg ("%d waiters: %d wake-ups in %lld ticks",
+       WAITER_CNT, WAITER_CNT * ROUND_CNT, ticks);
+  pass ();
+}
+
+static void 
+waiter_thread (void *i) 
+{
+  sema_down (&sema);
+  woken[woken_cnt++] = (int) i;
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing result for 200 waiters"
+  unless grep (/^\(priority-sema-many\) 200 waiters: 10000 wake-ups in \d+ ticks$/,
+	       @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(priority-sema-many) PASS', @output);
+
+pass;
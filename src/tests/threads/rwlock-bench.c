@@ -0,0 +1,127 @@
+/* Compares the throughput of a read-mostly workload protected by
+   a lock and by a readers-writer lock.  Each of several threads
+   reads 19 times for every write, and yields in the middle of
+   each section, as if it had to wait for something.  Under the
+   readers-writer lock, readers can overlap, so more sections
+   should complete.  The readers-writer lock is run again with
+   twice as many threads.  Also checks that a writer never
+   overlaps with a reader or another writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 8
+#define MANY_THREAD_CNT (THREAD_CNT * 2)
+#define BENCH_TICKS 50
+
+static thread_func bench_thread;
+
+static bool use_rwlock;
+static struct lock lock;
+static struct rwlock rwlock;
+
+static volatile bool stop;
+static long long op_cnt;
+static int readers, writers;
+static struct semaphore done;
+
+static void
+bench (bool rw, int thread_cnt)
+{
+  int i;
+
+  use_rwlock = rw;
+  stop = false;
+  op_cnt = 0;
+  sema_init (&done, 0);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "b%d", i);
+      if (thread_create (name, PRI_DEFAULT, bench_thread, NULL)
+          == TID_ERROR)
+        fail ("creating thread %d failed", i);
+    }
+
+  timer_sleep (BENCH_TICKS);
+  stop = true;
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+
+  msg ("%s, %d threads: %lld sections in %d ticks",
+       rw ? "rwlock" : "lock", thread_cnt, op_cnt, BENCH_TICKS);
+}
+
+void
+test_rwlock_bench (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  rwlock_init (&rwlock);
+  thread_set_priority (PRI_DEFAULT + 1);
+  bench (false, THREAD_CNT);
+  bench (true, THREAD_CNT);
+  bench (true, MANY_THREAD_CNT);
+  pass ();
+}
+
+static void
+read_section (void)
+{
+  if (writers != 0)
+    fail ("reader overlaps with a writer");
+  readers++;
+  thread_yield ();
+  readers--;
+}
+
+static void
+write_section (void)
+{
+  if (readers != 0 || writers != 0)
+    fail ("writer overlaps with another thread");
+  writers++;
+  thread_yield ();
+  writers--;
+}
+
+static void 
+bench_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; !stop; i++)
+    {
+      bool write = i % 20 == 0;
+
+      if (use_rwlock && !write)
+        {
+          rwlock_acquire_read (&rwlock);
+          read_section ();
+          rwlock_release_read (&rwlock);
+        }
+      else if (use_rwlock)
+        {
+          rwlock_acquire_write (&rwlock);
+          write_section ();
+          rwlock_release_write (&rwlock);
+        }
+      else
+        {
+          lock_acquire (&lock);
+          if (write)
+            write_section ();
+          else
+            read_section ();
+          lock_release (&lock);
+        }
+      op_cnt++;
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $kind ('lock, 8', 'rwlock, 8', 'rwlock, 16') {
+    fail "missing result for $kind threads"
+      unless grep (/^\(rwlock-bench\) $kind threads: \d+ sections in \d+ ticks$/,
+		   @output);
+}
+fail "missing PASS in output"
+  unless grep ($_ eq '(rwlock-bench) PASS', @output);
+
+pass;
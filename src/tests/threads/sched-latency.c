@@ -0,0 +1,74 @@
+/* Measures the cost of a context switch with 10, 100 and 500
+   threads ready to run.  Every thread yields in a loop, so each
+   yield switches to the next ready thread, while the main thread
+   sleeps at a higher priority for a fixed number of ticks.  The
+   scheduler picks the next thread in constant time, so the
+   latency should not grow with the number of ready threads. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BENCH_TICKS 50
+
+static thread_func yield_thread;
+
+static volatile bool stop;
+static volatile long long yield_cnt;
+static struct semaphore done;
+
+static void
+bench (int thread_cnt)
+{
+  long long us;
+  int i;
+
+  stop = false;
+  yield_cnt = 0;
+  sema_init (&done, 0);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "y%d", i);
+      if (thread_create (name, PRI_DEFAULT, yield_thread, NULL)
+          == TID_ERROR)
+        fail ("creating thread %d of %d failed", i, thread_cnt);
+    }
+
+  timer_sleep (BENCH_TICKS);
+  stop = true;
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+
+  us = BENCH_TICKS * 1000000LL / TIMER_FREQ;
+  msg ("%d threads: %lld switches in %lld us, %lld ns per switch",
+       thread_cnt, yield_cnt, us,
+       yield_cnt > 0 ? us * 1000 / yield_cnt : 0);
+}
+
+void
+test_sched_latency (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_set_priority (PRI_DEFAULT + 1);
+  bench (10);
+  bench (100);
+  bench (500);
+  pass ();
+}
+
+static void 
+yield_thread (void *aux UNUSED) 
+{
+  while (!stop)
+    {
+      yield_cnt++;
+      thread_yield ();
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $cnt (10, 100, 500) {
+    fail "missing result for $cnt threads"
+      unless grep (/^\(sched-latency\) $cnt threads: \d+ switches/, @output);
+}
+fail "missing PASS in output"
+  unless grep ($_ eq '(sched-latency) PASS', @output);
+
+pass;
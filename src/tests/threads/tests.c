@@ -17,6 +17,8 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-timer", test_alarm_timer},
+    {"alarm-workqueue", test_alarm_workqueue},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -29,6 +31,13 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"priority-sema-many", test_priority_sema_many},
+    {"sched-latency", test_sched_latency},
+    {"rwlock-bench", test_rwlock_bench},
+    {"priority-donate-rwlock", test_priority_donate_rwlock},
+    {"priority-donate-rekey", test_priority_donate_rekey},
+    {"thread-churn", test_thread_churn},
+    {"edf-periodic", test_edf_periodic},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -11,6 +11,8 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_timer;
+extern test_func test_alarm_workqueue;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -23,6 +25,13 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_priority_sema_many;
+extern test_func test_sched_latency;
+extern test_func test_rwlock_bench;
+extern test_func test_priority_donate_rwlock;
+extern test_func test_priority_donate_rekey;
+extern test_func test_thread_churn;
+extern test_func test_edf_periodic;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
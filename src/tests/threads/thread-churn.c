@@ -0,0 +1,44 @@
+/* Measures thread creation and teardown: creates threads that
+   exit at once, one after the other, for a fixed number of
+   ticks.  The pages of dead threads are reused by the next ones
+   without going through the page allocator. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BENCH_TICKS 50
+
+static thread_func exit_thread;
+
+static struct semaphore done;
+
+void
+test_thread_churn (void) 
+{
+  int64_t start;
+  long long cnt = 0;
+
+  sema_init (&done, 0);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS)
+    {
+      if (thread_create ("churn", PRI_DEFAULT, exit_thread, NULL)
+          == TID_ERROR)
+        fail ("creating thread %lld failed", cnt);
+      sema_down (&done);
+      cnt++;
+    }
+
+  msg ("%lld threads created and exited in %d ticks", cnt, BENCH_TICKS);
+  pass ();
+}
+
+static void 
+exit_thread (void *aux UNUSED) 
+{
+  sema_up (&done);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing result"
+  unless grep (/^\(thread-churn\) \d+ threads created and exited in \d+ ticks$/,
+	       @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(thread-churn) PASS', @output);
+
+pass;
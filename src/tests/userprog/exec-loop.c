@@ -0,0 +1,39 @@
+/* Executes itself and waits for the child, many times in a row,
+   so that each new process runs on the recycled page of a thread
+   that just exited.  User programs cannot read the timer, so this
+   checks the recycling rather than timing it; thread-churn does
+   the timing. */
+
+#include <debug.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+#define EXEC_CNT 50
+
+const char *test_name = "exec-loop";
+
+int
+main (int argc, char *argv[] UNUSED) 
+{
+  int i;
+
+  /* The child just exits. */
+  if (argc > 1)
+    return 7;
+
+  msg ("begin");
+  for (i = 0; i < EXEC_CNT; i++)
+    {
+      pid_t child_pid = exec ("exec-loop child");
+      int code;
+
+      if (child_pid == -1)
+        fail ("exec #%d failed", i);
+      code = wait (child_pid);
+      if (code != 7)
+        fail ("wait(exec #%d) returned %d", i, code);
+    }
+  msg ("end");
+  return 0;
+}
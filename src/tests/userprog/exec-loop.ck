@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($expected) = "(exec-loop) begin\n"
+  . "exec-loop: exit(7)\n" x 50
+  . "(exec-loop) end\n"
+  . "exec-loop: exit(0)\n";
+check_expected ([$expected]);
+pass;
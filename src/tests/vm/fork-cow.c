@@ -0,0 +1,42 @@
+/* Forks a child which writes to the pages it shares copy on write
+   with the parent, and verifies that the parent's pages are left
+   unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (16 * 4096)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'p', SIZE);
+
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      /* Child: check the parent's data, then overwrite it. */
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != 'p')
+          exit (1);
+      memset (buf, 'c', SIZE);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != 'c')
+          exit (2);
+      exit (42);
+    }
+
+  CHECK (wait (child) == 42, "wait for child");
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 'p')
+      fail ("byte %zu of parent changed to '%c'", i, buf[i]);
+  msg ("parent data unchanged");
+}
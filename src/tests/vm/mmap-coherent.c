@@ -0,0 +1,77 @@
+/* Maps a file of more pages than the page cache lets processes map
+   at once, and checks that the mapping, read(), write() and the
+   mapping of a child process all see the same data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 32
+#define SIZE (PAGE_CNT * 4096)
+#define ACTUAL ((char *) 0x10000000)
+#define CHILD_ACTUAL ((char *) 0x20000000)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  pid_t child;
+  size_t i;
+
+  CHECK (create ("big.dat", SIZE), "create \"big.dat\"");
+  CHECK ((handle = open ("big.dat")) > 1, "open \"big.dat\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"big.dat\"");
+
+  /* Write every page through the mapping, then the second byte of
+     each page with write(). */
+  for (i = 0; i < PAGE_CNT; i++)
+    memset (ACTUAL + i * 4096, 'a' + i % 26, 4096);
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      seek (handle, i * 4096 + 1);
+      if (write (handle, "w", 1) != 1)
+        fail ("write to page %zu failed", i);
+    }
+  msg ("write data");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (ACTUAL[i * 4096 + 1] != 'w')
+      fail ("page %zu of the mapping misses the write()", i);
+  seek (handle, 0);
+  if (read (handle, buf, SIZE) != SIZE)
+    fail ("read \"big.dat\" failed");
+  if (memcmp (buf, ACTUAL, SIZE))
+    fail ("read() and the mapping differ");
+  msg ("mapping and file agree");
+
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      /* Child: map the file too, check the parent's data, and mark
+         the third byte of each page. */
+      int child_handle = open ("big.dat");
+      if (child_handle < 2
+          || mmap (child_handle, CHILD_ACTUAL) == MAP_FAILED)
+        exit (1);
+      for (i = 0; i < PAGE_CNT; i++)
+        if (CHILD_ACTUAL[i * 4096] != 'a' + (int) (i % 26)
+            || CHILD_ACTUAL[i * 4096 + 1] != 'w')
+          exit (2);
+      for (i = 0; i < PAGE_CNT; i++)
+        CHILD_ACTUAL[i * 4096 + 2] = 'c';
+      exit (42);
+    }
+  CHECK (wait (child) == 42, "wait for child");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (ACTUAL[i * 4096 + 2] != 'c')
+      fail ("page %zu of the mapping misses the child's write", i);
+  msg ("child's writes visible");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-coherent) begin
+(mmap-coherent) create "big.dat"
+(mmap-coherent) open "big.dat"
+(mmap-coherent) mmap "big.dat"
+(mmap-coherent) write data
+(mmap-coherent) mapping and file agree
+(mmap-coherent) fork
+(mmap-coherent) wait for child
+(mmap-coherent) child's writes visible
+(mmap-coherent) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Writes to a file through a mapping and writes it back with
+   msync, checking that msync fails for a bad mapping.  Then does
+   the same with MS_ASYNC on a second file.  Each file is unmapped
+   and closed before it is read back, so its pages leave the page
+   cache and the data read comes from the file system.  (The data
+   reaches the file anyway when the mapping goes away, so this
+   checks that msync leaves it intact, not when it is written.) */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+static void
+write_file (const char *file_name, int flags)
+{
+  int handle;
+  mapid_t map;
+
+  CHECK (create (file_name, strlen (sample)), "create \"%s\"", file_name);
+  CHECK ((handle = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"%s\"",
+         file_name);
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (map, flags) == 0, "msync \"%s\"", file_name);
+  CHECK (msync (map + 1, flags) == -1, "msync bad mapping");
+  munmap (map);
+  close (handle);
+}
+
+void
+test_main (void)
+{
+  write_file ("sample.txt", MS_SYNC);
+  check_file ("sample.txt", sample, strlen (sample));
+
+  write_file ("async.txt", MS_ASYNC);
+  check_file ("async.txt", sample, strlen (sample));
+}
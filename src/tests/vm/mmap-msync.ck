@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "sample.txt"
+(mmap-msync) open "sample.txt"
+(mmap-msync) mmap "sample.txt"
+(mmap-msync) msync "sample.txt"
+(mmap-msync) msync bad mapping
+(mmap-msync) open "sample.txt" for verification
+(mmap-msync) verified contents of "sample.txt"
+(mmap-msync) close "sample.txt"
+(mmap-msync) create "async.txt"
+(mmap-msync) open "async.txt"
+(mmap-msync) mmap "async.txt"
+(mmap-msync) msync "async.txt"
+(mmap-msync) msync bad mapping
+(mmap-msync) open "async.txt" for verification
+(mmap-msync) verified contents of "async.txt"
+(mmap-msync) close "async.txt"
+(mmap-msync) end
+EOF
+pass;
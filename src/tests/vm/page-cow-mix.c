@@ -0,0 +1,52 @@
+/* Forks a child which shares a buffer copy on write with its
+   parent, makes every other page of it private, then uses enough
+   memory to push the buffer out.  The pageout work evicts shared
+   and private frames of the child in the same batches.  Checks
+   that both copies of the buffer survive. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+#define SIZE (1024 * 1024)
+#define PRESSURE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+static char pressure[PRESSURE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i / PAGE;
+
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      /* Child: break the sharing of the even pages. */
+      for (i = 0; i < SIZE; i += 2 * PAGE)
+        memset (buf + i, 'c', PAGE);
+
+      memset (pressure, 0x5a, PRESSURE);
+      for (i = 0; i < PRESSURE; i++)
+        if (pressure[i] != 0x5a)
+          exit (1);
+
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != ((i / PAGE) % 2 == 0 ? 'c' : (char) (i / PAGE)))
+          exit (2);
+      exit (42);
+    }
+
+  CHECK (wait (child) == 42, "wait for child");
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i / PAGE))
+      fail ("byte %zu of parent changed to %d", i, buf[i]);
+  msg ("parent data unchanged");
+}
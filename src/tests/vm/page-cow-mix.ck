@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-cow-mix) begin
+(page-cow-mix) fork
+(page-cow-mix) wait for child
+(page-cow-mix) parent data unchanged
+(page-cow-mix) end
+EOF
+pass;
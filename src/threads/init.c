@@ -22,6 +22,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -41,6 +42,7 @@
 #include "vm/frame.h"
 #include "vm/swap.h"
 #include "vm/page.h"
+#include "vm/zswap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -112,6 +114,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  workqueue_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -122,6 +125,7 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_start ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -161,15 +165,55 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns the CPUID feature flags in EDX.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
+/* Returns true if the 4 MB region of physical memory starting at
+   PADDR can be mapped by a single large page: it lies in RAM,
+   holds no kernel text, which is mapped read-only, and no user
+   pool frame, whose dirty bit in its kernel mapping is tracked
+   per page by the VM. */
+static bool
+large_page_ok (uintptr_t paddr)
+{
+  extern char _start, _end_kernel_text;
+  char *vaddr = ptov (paddr);
+  size_t page;
+
+  if (paddr / PGSIZE + LARGE_PGSIZE / PGSIZE > init_ram_pages)
+    return false;
+  if (vaddr < &_end_kernel_text && &_start < vaddr + LARGE_PGSIZE)
+    return false;
+  for (page = 0; page < LARGE_PGSIZE / PGSIZE; page++)
+    if (palloc_is_user_page (vaddr + page * PGSIZE))
+      return false;
+  return true;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU has them, kernel pages are global, so they stay in
+   the TLB across process switches, and 4 MB regions of the
+   kernel pool are mapped by large pages. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  uint32_t features = cpu_features ();
+  bool pse = (features & (1 << 3)) != 0;
+  bool pge = (features & (1 << 13)) != 0;
+  uint32_t cr4;
   extern char _start, _end_kernel_text;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -184,13 +228,28 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          if (pse && paddr % LARGE_PGSIZE == 0 && large_page_ok (paddr))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true);
+              page += LARGE_PGSIZE / PGSIZE - 1;
+              continue;
+            }
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
+  /* Large pages must be enabled before they are used, global pages
+     are ignored without CR4_PGE. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (pse)
+    cr4 |= CR4_PSE;
+  if (pge)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -267,9 +326,21 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-async-clean"))
+        frame_async_clean = true;
+      else if (!strcmp (name, "-pageout-low"))
+        frame_low_wm = atoi (value);
+      else if (!strcmp (name, "-pageout-high"))
+        frame_high_wm = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -390,8 +461,15 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer tick while idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -async-clean       Write back dirty user pages in background.\n"
+          "  -pageout-low=N     Start paging out below N free user pages.\n"
+          "  -pageout-high=N    Stop paging out at N free user pages.\n"
+          "  -zswap=N           Keep up to N pages of compressed swap in RAM.\n"
 #endif
           );
   shutdown_power_off ();
@@ -8,6 +8,7 @@
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -47,6 +48,13 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* The bottom halves raised by the handlers run on the return of
+   an external interrupt, with interrupts on so that other
+   interrupts are not held up.  Like the handlers, they may not
+   sleep.  An interrupt that comes in meanwhile leaves its bottom
+   halves and its yield to the interrupt that runs them. */
+static bool in_softirq;         /* Are we running bottom halves? */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -88,7 +96,7 @@ enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -206,12 +214,12 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt or
+   of its bottom halves and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_softirq;
 }
 
 /* During processing of an external interrupt, directs the
@@ -355,10 +363,11 @@ intr_handler (struct intr_frame *frame)
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_softirq)
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -383,6 +392,17 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
+      if (in_softirq)
+        return;
+      if (softirq_pending ())
+        {
+          in_softirq = true;
+          intr_enable ();
+          softirq_run ();
+          intr_disable ();
+          in_softirq = false;
+        }
+
       if (yield_on_return) 
         thread_yield (); 
     }
@@ -66,6 +66,17 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page (PDEs only, needs CR4_PSE). */
+#define PTE_G 0x100             /* 1=global, kept in the TLB across CR3
+                                   loads (needs CR4_PGE). */
+
+/* Control register 4 bits for large and global pages.  See
+   [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x10            /* Page size extensions. */
+#define CR4_PGE 0x80            /* Page global enable. */
+
+/* Size of a large page. */
+#define LARGE_PGSIZE PTSPAN
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,6 +84,13 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the large page at PAGE, for the kernel
+   only, as a global page.  See pte_create_kernel(). */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT ((uintptr_t) page % LARGE_PGSIZE == 0);
+  return vtop (page) | PTE_P | PTE_PS | PTE_G | (writable ? PTE_W : 0);
+}
+
 /* Returns a pointer to the page table that page directory entry
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
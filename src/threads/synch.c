@@ -30,10 +30,21 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/thread.h"
 
-static void donate_priority (struct thread *, int depth, int prev_priority);
-static int get_highest_priority_locks (struct thread *t, int depth);
+static void lock_take (struct lock *);
+static int lock_waiter_priority (struct lock *);
+static void lock_set_priority (struct lock *, int priority, int depth);
+static void update_donation (struct thread *, int depth);
+static bool waiter_before (struct thread *, unsigned seq_a,
+                           struct thread *, unsigned seq_b);
+static heap_less_func sema_waiter_less;
+static heap_less_func cond_waiter_less;
+
+/* Arrival order of waiters, to wake up threads of the same
+   priority first come, first served. */
+static unsigned next_wait_seq;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -50,7 +61,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, sema_waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -71,7 +82,18 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+
+      cur->wait_seq = next_wait_seq++;
+      heap_insert (&sema->waiters, &cur->waitelem);
+
+      /* Requeue the thread here if its priority changes, unless
+         it waits in cond_wait(), which requeues it there. */
+      if (cur->wait_heap == NULL)
+        {
+          cur->wait_heap = &sema->waiters;
+          cur->wait_heap_elem = &cur->waitelem;
+        }
       thread_block ();
     }
   sema->value--;
@@ -118,16 +140,26 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   /* Unblock the highest priority thread waiting for the semaphore. */
-  if (!list_empty (&sema->waiters)) 
-    thread_unblock (t = highest_priority_thread (&sema->waiters, true));
+  if (!heap_empty (&sema->waiters)) 
+    {
+      t = heap_entry (heap_pop (&sema->waiters), struct thread, waitelem);
+      if (t->wait_heap == &sema->waiters)
+        t->wait_heap = NULL;
+      thread_unblock (t);
+    }
 
   sema->value++;
   intr_set_level (old_level);
 
-  /* Yields if t is found and has higher priority than current thread. */
-  if (!intr_context() && is_thread(t) && 
-    (thread_get_priority_thread (t) > thread_get_priority ()))
-      thread_yield ();
+  /* Yields if t is found and has higher priority than current
+     thread.  A deadline thread preempts even from an interrupt. */
+  if (is_thread (t) && thread_more_urgent (t, thread_current ()))
+    {
+      if (!intr_context ())
+        thread_yield ();
+      else if (t->dl_admitted)
+        intr_yield_on_return ();
+    }
 }
 
 static void sema_test_helper (void *sema_);
@@ -186,7 +218,7 @@ void
 lock_init (struct lock *lock)
 {
   ASSERT (lock != NULL);
-  lock->highest_acq_priority = PRI_MIN;
+  lock->priority = PRI_MIN;
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
 }
@@ -202,7 +234,6 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
-  int acquirepriority;
   enum intr_level old_level;
   struct thread *cur = thread_current ();
 
@@ -210,37 +241,25 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  /* Priority donation */
+  /* Donation and changing the lock holder should not be
+     interrupted. */
+  old_level = intr_disable ();
+
+  /* Priority donation: once we wait, the lock's highest waiter
+     priority is at least ours. */
   if (lock->holder && !thread_mlfqs)
     {
-      acquirepriority = thread_get_priority ();
-      /* Setting the blockedby and lock_acquiring should not 
-       be interrupted. */
-      old_level = intr_disable();
-      
-      /* Maintaining the lock's highest acquire priority. */
-      if (acquirepriority > lock->highest_acq_priority)
-        lock->highest_acq_priority = acquirepriority;
-
-      cur->blockedby = lock->holder;
       cur->lock_acquiring = lock;
-      
-      intr_set_level(old_level);
-      /* Donate the priority to thread holding the lock. */
-      donate_priority (cur, PRI_DONATION_LIMIT, PRI_MIN);
+      if (thread_get_priority () > lock->priority)
+        lock_set_priority (lock, thread_get_priority (),
+                           PRI_DONATION_LIMIT);
     }
 
-  /* Changing the lock holder should not be interrupted. */
-  old_level = intr_disable ();
   sema_down (&lock->semaphore);
-
-  lock->holder = thread_current ();
-  lock->highest_acq_priority = thread_get_priority();
   cur->lock_acquiring = NULL;
-  list_push_back (&cur->holdinglocks, &lock->elem);
-  cur->blockedby = NULL;
+  lock_take (lock);
 
-  intr_set_level(old_level);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -252,19 +271,17 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
-  struct thread *t;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success) 
-    {
-      t = thread_current ();
-      list_push_back (&t->holdinglocks, &lock->elem);
-      lock->holder = t;
-    }
+    lock_take (lock);
+  intr_set_level (old_level);
     
   return success;
 }
@@ -278,17 +295,18 @@ void
 lock_release (struct lock *lock) 
 {
   struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  /* The donation of the lock's waiters ends with it. */
+  old_level = intr_disable ();
   lock->holder = NULL;
-  list_remove (&lock->elem);
-  
-  /* Priority donation */
+  heap_remove (&cur->holdinglocks, &lock->elem);
   if (!thread_mlfqs)
-    cur->donatedpriority = get_highest_priority_locks (cur, 
-                                            PRI_DONATION_LIMIT);
+    update_donation (cur, PRI_DONATION_LIMIT);
+  intr_set_level (old_level);
 
   sema_up (&lock->semaphore);
 }
@@ -304,11 +322,13 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a condition's wait queue. */
 struct semaphore_elem 
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
+    unsigned seq;                       /* Arrival order. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -319,7 +339,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -346,6 +366,8 @@ void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
   struct semaphore_elem waiter;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -353,7 +375,16 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.thread = cur;
+
+  /* Priority donation may requeue the waiter at any time. */
+  old_level = intr_disable ();
+  waiter.seq = next_wait_seq++;
+  heap_insert (&cond->waiters, &waiter.elem);
+  cur->wait_heap = &cond->waiters;
+  cur->wait_heap_elem = &waiter.elem;
+  intr_set_level (old_level);
+
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -369,50 +400,26 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) 
 {
-  struct list_elem *e;
-  struct list_elem *max_e;
-  struct semaphore *sema_max_priority;
-  int max_priority = PRI_MIN;
+  struct semaphore_elem *waiter = NULL;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  /* Get the semaphore with the highest priority waiter. */
-  if (!list_empty (&cond->waiters)) 
+  /* Take the waiter with the highest priority. */
+  old_level = intr_disable ();
+  if (!heap_empty (&cond->waiters)) 
     {
-      e = list_begin (&cond->waiters);
-      max_e = e;
-      sema_max_priority = &list_entry (max_e, 
-                              struct semaphore_elem, elem)->semaphore;
-      
-      /* A list traversal, pretty straightforward. */
-      for (; e != list_end (&cond->waiters); e = list_next (e))
-        {
-          struct semaphore *sema = &list_entry (e, 
-                                     struct semaphore_elem, elem)->semaphore;
-          if (!list_empty (&sema->waiters))
-            {
-              struct thread *t = 
-                      highest_priority_thread (&sema->waiters, false);
-              int thread_priority = thread_get_priority_thread (t);
-
-              if (thread_priority > max_priority)
-                {
-                  max_e = e;
-                  sema_max_priority = sema;
-                  max_priority = thread_priority;
-                }
-            }
-        }
-      /* Remove the thread in cond->waiters with the highest priority. */
-      list_remove (max_e);
-
-      /* Unblock the thread by sema_up. */
-      sema_up (sema_max_priority);
+      waiter = heap_entry (heap_pop (&cond->waiters),
+                           struct semaphore_elem, elem);
+      waiter->thread->wait_heap = NULL;
     }
+  intr_set_level (old_level);
 
+  if (waiter != NULL)
+    sema_up (&waiter->semaphore);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -427,69 +434,270 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
 
-/* Donate the priority to the lock holders with search depth `depth' 
-  and the previous acquiring thread's priority prev_priority. */
-static void 
-donate_priority (struct thread *t, int depth, int prev_priority) 
+/* A thread holding an rwlock for reading.  It holds LOCK as long
+   as it reads, so a writer waiting for it to leave acquires LOCK
+   and donates its priority to it. */
+struct rwlock_reader
+  {
+    struct lock lock;           /* Held by the reader. */
+    bool waited;                /* A writer waits for it, and frees it. */
+    struct list_elem elem;      /* Element in rwlock's readers. */
+  };
+
+/* Initializes RW.  A readers-writer lock can be held by any
+   number of readers at once, or by a single writer.
+
+   The writer holds RW's internal lock for the whole write
+   section, and readers hold it while they register.  The threads
+   waiting for it, readers and writers alike, are served by
+   priority, then first come, first served, so neither side
+   starves.  A waiting writer keeps new readers out.
+
+   Each reader holds a lock of its own, so a writer waiting for
+   the readers to leave donates its priority to each of them in
+   turn, the same as to the holder of a lock, and so do the
+   threads waiting behind the writer. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  list_init (&rw->readers);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   waits for it.  RW must not already be held by the current
+   thread for writing.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
 {
+  struct rwlock_reader *reader;
   enum intr_level old_level;
-  int priority = prev_priority;
-  ASSERT (!thread_mlfqs);
 
-  if (depth <= 0 || !is_thread(t)) 
-    return;
+  ASSERT (rw != NULL);
 
-  /* Get the donated priority from searching the locks t holds. */
-  t->donatedpriority = get_highest_priority_locks (t, PRI_DONATION_LIMIT);
-  old_level = intr_disable();
-
-  /* Set donated priority and priority to 
-   max(donated priority, prev priority). */
-  if (t->donatedpriority < prev_priority)
-    t->donatedpriority = prev_priority;
-  else 
-    priority = t->donatedpriority;
-
-  /* Keep priority be the maximum of the thread's donated priority 
-   and original priority. */
-  if (t->priority > priority)
-    priority = t->priority;
-
-  /* If the updated priority is greater than the highest acquire priority 
-   of the lock it is acquiring, set it to be the highest acquire priority. */
-  if (t->lock_acquiring && 
-        priority > t->lock_acquiring->highest_acq_priority)
-    t->lock_acquiring->highest_acq_priority = priority;
-
-  intr_set_level(old_level);
-  
-  /* Donate the priority to the thread that blocks t. */
-  return donate_priority (t->blockedby, depth - 1, priority);
+  reader = malloc (sizeof *reader);
+  ASSERT (reader != NULL);
+  lock_init (&reader->lock);
+  reader->waited = false;
+  lock_acquire (&reader->lock);
+
+  lock_acquire (&rw->lock);
+  old_level = intr_disable ();
+  list_push_back (&rw->readers, &reader->elem);
+  intr_set_level (old_level);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  struct rwlock_reader *reader = NULL;
+  enum intr_level old_level;
+  struct list_elem *e;
+  bool waited;
+
+  ASSERT (rw != NULL);
+
+  /* A writer may be walking the list. */
+  old_level = intr_disable ();
+  for (e = list_begin (&rw->readers); e != list_end (&rw->readers);
+       e = list_next (e))
+    {
+      reader = list_entry (e, struct rwlock_reader, elem);
+      if (lock_held_by_current_thread (&reader->lock))
+        break;
+    }
+  ASSERT (e != list_end (&rw->readers));
+  list_remove (&reader->elem);
+  waited = reader->waited;
+  intr_set_level (old_level);
+
+  /* A writer that waits for READER frees it once it gets READER's
+     lock. */
+  lock_release (&reader->lock);
+  if (!waited)
+    free (reader);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  RW must not already be held by the current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+
+  /* Wait for the readers to leave.  No reader comes in while we
+     hold RW's lock. */
+  old_level = intr_disable ();
+  while (!list_empty (&rw->readers))
+    {
+      struct rwlock_reader *reader = list_entry (list_front (&rw->readers),
+                                                 struct rwlock_reader, elem);
+      reader->waited = true;
+      intr_set_level (old_level);
+
+      lock_acquire (&reader->lock);
+      lock_release (&reader->lock);
+      free (reader);
+      old_level = intr_disable ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rwlock_held_by_current_thread (rw));
+
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->lock);
+}
+
+/* Makes the current thread the holder of LOCK, which it just
+   took.  The threads still waiting donate to it.  Interrupts must
+   be off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->priority = lock_waiter_priority (lock);
+  heap_insert (&cur->holdinglocks, &lock->elem);
+  if (!thread_mlfqs)
+    update_donation (cur, PRI_DONATION_LIMIT);
 }
 
-/* Get the highest acquiring priority in the holding locks 
-  if the thread is not holding any locks, return PRI_MIN. */
+/* Returns the highest priority of the threads waiting for LOCK,
+   or PRI_MIN if there are none.  Interrupts must be off. */
 static int
-get_highest_priority_locks (struct thread *t, int depth)
+lock_waiter_priority (struct lock *lock)
 {
-  struct list_elem *e1;
-  int max_donated = PRI_MIN;
-  
-  if (depth <= 0) 
+  struct heap *waiters = &lock->semaphore.waiters;
+
+  if (heap_empty (waiters))
     return PRI_MIN;
+  return thread_get_priority_thread (heap_entry (heap_top (waiters),
+                                                 struct thread, waitelem));
+}
 
-  for (e1 = list_begin (&t->holdinglocks); e1 != list_end (&t->holdinglocks);
-    e1 = list_next (e1))
+/* Sets the highest waiter priority of LOCK to PRIORITY and
+   passes it on to the holder, with search depth DEPTH.
+   Interrupts must be off. */
+static void
+lock_set_priority (struct lock *lock, int priority, int depth)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->priority = priority;
+  if (lock->holder != NULL)
     {
-      struct lock *l = list_entry (e1, struct lock, elem);
-      if (l->highest_acq_priority > max_donated)
-        max_donated = l->highest_acq_priority;
+      heap_rekey (&lock->holder->holdinglocks, &lock->elem);
+      update_donation (lock->holder, depth);
     }
-  
-  return max_donated;
 }
 
+/* Sets T's donated priority to the highest waiter priority of
+   the locks it holds.  If that changes T's priority, requeues T
+   and passes the change on to the holder of the lock T waits
+   for, as long as DEPTH, the number of threads of the chain left
+   to update, allows it.  Interrupts must be off. */
+static void
+update_donation (struct thread *t, int depth)
+{
+  int old_priority = thread_get_priority_thread (t);
+  struct lock *lock = t->lock_acquiring;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (heap_empty (&t->holdinglocks))
+    t->donatedpriority = PRI_MIN;
+  else
+    t->donatedpriority = heap_entry (heap_top (&t->holdinglocks),
+                                     struct lock, elem)->priority;
+  if (thread_get_priority_thread (t) == old_priority)
+    return;
+
+  /* A ready thread moves to its new run queue, a waiting one to
+     its new place among the waiters. */
+  thread_requeue (t);
+  if (depth > 1 && lock != NULL
+      && lock_waiter_priority (lock) != lock->priority)
+    lock_set_priority (lock, lock_waiter_priority (lock), depth - 1);
+}
+
+/* Orders the locks a thread holds by their highest waiter
+   priority, highest first. */
+bool
+lock_priority_higher (const struct heap_elem *a_,
+                      const struct heap_elem *b_, void *aux UNUSED)
+{
+  const struct lock *a = heap_entry (a_, struct lock, elem);
+  const struct lock *b = heap_entry (b_, struct lock, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Returns true if thread A, which arrived at SEQ_A, is to be woken
+   up before thread B, which arrived at SEQ_B. */
+static bool
+waiter_before (struct thread *a, unsigned seq_a,
+               struct thread *b, unsigned seq_b)
+{
+  if (thread_more_urgent (a, b))
+    return true;
+  if (thread_more_urgent (b, a))
+    return false;
+  return (int) (seq_a - seq_b) < 0;
+}
+
+/* Orders the threads waiting on a semaphore. */
+static bool
+sema_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  struct thread *a = heap_entry (a_, struct thread, waitelem);
+  struct thread *b = heap_entry (b_, struct thread, waitelem);
+
+  return waiter_before (a, a->wait_seq, b, b->wait_seq);
+}
+
+/* Orders the semaphores waiting on a condition by their threads. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  struct semaphore_elem *a = heap_entry (a_, struct semaphore_elem, elem);
+  struct semaphore_elem *b = heap_entry (b_, struct semaphore_elem, elem);
+
+  return waiter_before (a->thread, a->seq, b->thread, b->seq);
+}
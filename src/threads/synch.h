@@ -1,6 +1,7 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
@@ -8,7 +9,7 @@
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -22,8 +23,8 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
-    int highest_acq_priority;   /* Highest priority thread acquiring lock. */
-    struct list_elem elem;      /* List element for holdinglocks */
+    int priority;               /* Highest priority of its waiters. */
+    struct heap_elem elem;      /* Heap element for holdinglocks. */
   };
 
 void lock_init (struct lock *);
@@ -31,11 +32,13 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+bool lock_priority_higher (const struct heap_elem *,
+                           const struct heap_elem *, void *aux);
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void cond_init (struct condition *);
@@ -43,6 +46,20 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock 
+  {
+    struct lock lock;           /* Held by the writer, briefly by readers. */
+    struct list readers;        /* One struct rwlock_reader per reader. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -50,7 +67,9 @@ void cond_broadcast (struct condition *, struct lock *);
    reference guide for more information.*/
 #define barrier() asm volatile ("" : : : "memory")
 
-/* Depth limit on nested priority donation */
-#define PRI_DONATION_LIMIT 0
+/* Number of threads a donation passes through along a chain of
+   lock holders.  priority-donate-chain nests 8 deep.  The bound
+   keeps a donation, done with interrupts off, short. */
+#define PRI_DONATION_LIMIT 8
 
 #endif /* threads/synch.h */
@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -25,13 +26,34 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is a FIFO queue
+   for each priority, bit P of ready_bitmap is set if queue P is
+   not empty, so the highest priority ready thread is found with a
+   single bit scan. */
+static struct list ready_queues[PRI_CNT];
+static uint64_t ready_bitmap;
 
 /* Number of processes in THREAD_READY state. */
 static int ready_num;
 
+/* Deadline (EDF) scheduling class.  A thread admitted to it gets
+   dl_runtime ticks of CPU in every dl_period ticks, to be used
+   within dl_deadline ticks of the start of the period.  Ready
+   deadline threads run before all others, earliest deadline
+   first, from dl_ready instead of the priority queues.  One that
+   uses up its budget is throttled: it runs by its priority until
+   its next period starts. */
+static struct heap dl_ready;
+
+/* ready_priority of a thread in dl_ready. */
+#define READY_DEADLINE PRI_CNT
+
+/* Share of the CPU the deadline class may be given, in 1/1000s.
+   The rest is left to the other threads. */
+#define DL_UTIL_MAX 900
+static int dl_util;             /* Share admitted so far. */
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
@@ -42,8 +64,12 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Pages of threads that died lately, kept to be reused by
+   thread_create() without going through the page allocator.  Each
+   is linked through the allelem of the dead thread it held. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static size_t thread_cache_cnt;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -57,10 +83,22 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long dl_jobs;       /* # of deadline jobs finished. */
+static long long dl_misses;     /* # of deadline jobs finished late. */
+static long long dl_overruns;   /* # of deadline budgets used up. */
 
 /* System load average */
 static fixed_point sys_load_avg;
 
+/* recent_cpu decays once a second, but only the threads that can
+   run are decayed then.  A blocked thread catches up when it is
+   woken up, using the coefficients of the seconds it missed, kept
+   for the last DECAY_HISTORY seconds.  Decay older than that has
+   scaled recent_cpu down to nearly nothing, so it is dropped. */
+#define DECAY_HISTORY 256
+static fixed_point decay_coeff[DECAY_HISTORY];
+static int decay_seconds;       /* # of decays since boot. */
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
@@ -81,14 +119,23 @@ static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 static int thread_calculate_priority (struct thread *t);
-static fixed_point thread_calculate_recent_cpu (struct thread *t);
+static void thread_decay_recent_cpu (struct thread *t);
+static void ready_push (struct thread *t);
+static void ready_remove (struct thread *t);
+static int ready_highest_priority (void);
+static int ready_slot (struct thread *t);
+static bool runs_by_deadline (const struct thread *t);
+static heap_less_func dl_earlier;
+static timer_func dl_period_start;
+static void dl_release (struct thread *t, int64_t start);
+static void dl_leave (struct thread *t);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queue and the thread page cache.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -99,10 +146,15 @@ static fixed_point thread_calculate_recent_cpu (struct thread *t);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  list_init (&thread_cache);
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&ready_queues[i]);
+  ready_bitmap = 0;
+  heap_init (&dl_ready, dl_earlier, NULL);
   list_init (&all_list);
 
   ready_num = 0;
@@ -112,6 +164,7 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  list_push_back (&all_list, &initial_thread->allelem);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -148,17 +201,41 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  /* A deadline thread is not time sliced, but runs until its
+     budget is used up. */
+  if (runs_by_deadline (t))
+    {
+      if (--t->dl_budget <= 0)
+        {
+          t->dl_throttled = true;
+          dl_overruns++;
+          intr_yield_on_return ();
+        }
+      return;
+    }
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Called by the timer interrupt handler for a tick that passed
+   while the CPU was idle, without an interrupt of its own. */
+void
+thread_tick_idle (void)
+{
+  idle_ticks++;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (dl_jobs != 0 || dl_overruns != 0)
+    printf ("Thread: %lld deadline jobs, %lld missed, %lld budget overruns\n",
+            dl_jobs, dl_misses, dl_overruns);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -189,19 +266,32 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  /* Allocate thread.  init_thread() clears the struct thread, the
+     rest of the page is stack and need not be zeroed. */
+  old_level = intr_disable ();
+  if (!list_empty (&thread_cache))
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread,
+                      allelem);
+      thread_cache_cnt--;
+    }
+  else
+    t = NULL;
+  intr_set_level (old_level);
+  if (t == NULL)
+    t = palloc_get_page (0);
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
   old_level = intr_disable ();
+  tid = t->tid = allocate_tid ();
+  list_push_back (&all_list, &t->allelem);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -267,8 +357,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
-  ready_num += 1;
+  if (thread_mlfqs)
+    {
+      thread_decay_recent_cpu (t);
+      t->priority = thread_calculate_priority (t);
+    }
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -321,6 +415,8 @@ thread_exit (void)
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (thread_current ()->dl_admitted)
+    dl_leave (thread_current ());
   list_remove (&thread_current ()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -339,10 +435,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    {
-      list_push_back (&ready_list, &cur->elem);
-      ready_num += 1;
-    }
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -371,9 +464,9 @@ void
 thread_set_priority (int new_priority) 
 {
   thread_current ()->priority = new_priority;
-  if (ready_num != 0 && 
-    thread_get_priority_thread (highest_priority_thread (&ready_list, false))
-      > thread_get_priority ())
+  if (!heap_empty (&dl_ready)
+      || (ready_bitmap != 0
+          && ready_highest_priority () > thread_get_priority ()))
     thread_yield ();
 }
 
@@ -401,6 +494,144 @@ thread_get_priority_thread (struct thread *t)
   return t->priority > t->donatedpriority ? t->priority : t->donatedpriority;
 }
 
+/* Moves T to the run queue of its current priority if it is
+   ready, or to its place in the wait queue it is in, after its
+   priority, donated priority or deadline changed. */
+void
+thread_requeue (struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY)
+    {
+      if (t->ready_priority != ready_slot (t))
+        {
+          ready_remove (t);
+          ready_push (t);
+        }
+      else if (t->ready_priority == READY_DEADLINE)
+        heap_rekey (&dl_ready, &t->dl_elem);
+    }
+  if (t->wait_heap != NULL)
+    heap_rekey (t->wait_heap, t->wait_heap_elem);
+  intr_set_level (old_level);
+}
+
+/* Returns true if thread A should run before thread B: deadline
+   threads before all others, earliest deadline first, and the
+   rest by priority. */
+bool
+thread_more_urgent (struct thread *a, struct thread *b)
+{
+  bool dl_a = runs_by_deadline (a);
+  bool dl_b = runs_by_deadline (b);
+
+  if (dl_a != dl_b)
+    return dl_a;
+  if (dl_a)
+    return a->dl_abs_deadline < b->dl_abs_deadline;
+  return thread_get_priority_thread (a) > thread_get_priority_thread (b);
+}
+
+/* Admits the running thread to the deadline class, to run for
+   RUNTIME ticks in every PERIOD ticks, within DEADLINE ticks of
+   the start of each period.  Its first period starts now.
+   Returns false, leaving the thread as it was, if the parameters
+   are invalid or the class would get too much of the CPU. */
+bool
+thread_set_deadline (int64_t runtime, int64_t period, int64_t deadline)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int util;
+
+  ASSERT (!intr_context ());
+
+  if (runtime <= 0 || runtime > deadline || deadline > period)
+    return false;
+  util = DIV_ROUND_UP (runtime * 1000, period);
+
+  old_level = intr_disable ();
+  if (dl_util - cur->dl_util + util > DL_UTIL_MAX)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  if (cur->dl_admitted)
+    dl_leave (cur);
+  cur->dl_runtime = runtime;
+  cur->dl_period = period;
+  cur->dl_deadline = deadline;
+  cur->dl_util = util;
+  cur->dl_admitted = true;
+  dl_util += util;
+  timer_setup (&cur->dl_timer, dl_period_start, cur);
+  dl_release (cur, timer_ticks ());
+  cur->dl_job_idx = cur->dl_period_idx;
+  intr_set_level (old_level);
+
+  /* A deadline thread with an earlier deadline may be ready. */
+  thread_yield ();
+  return true;
+}
+
+/* Takes the running thread out of the deadline class, back to
+   scheduling by priority alone. */
+void
+thread_clear_deadline (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (cur->dl_admitted)
+    dl_leave (cur);
+  intr_set_level (old_level);
+  thread_yield ();
+}
+
+/* Finishes the running deadline thread's job and blocks until its
+   next period starts.  A job that overran its period was counted as
+   a miss when the period ended, and the job of the period that runs
+   now has not started yet, so it returns at once to run it. */
+void
+thread_wait_period (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+  ASSERT (cur->dl_admitted);
+
+  old_level = intr_disable ();
+  dl_jobs++;
+  if (cur->dl_job_idx == cur->dl_period_idx)
+    {
+      cur->dl_job_done = true;
+      if (timer_ticks () > cur->dl_abs_deadline)
+        {
+          cur->dl_misses++;
+          dl_misses++;
+        }
+      cur->dl_waiting = true;
+      thread_block ();
+    }
+  cur->dl_job_idx = cur->dl_period_idx;
+  intr_set_level (old_level);
+}
+
+/* Returns the number of deadlines the running thread missed. */
+int
+thread_get_deadline_misses (void)
+{
+  return thread_current ()->dl_misses;
+}
+
 /* Sets the current thread's nice value to NICE and recalculates the 
   thread's priority based on the new value. */
 void
@@ -431,7 +662,14 @@ thread_get_load_avg (void)
 int
 thread_get_recent_cpu (void) 
 {
-  return INT (FMULI (thread_current ()->recent_cpu, 100));
+  struct thread *t = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu;
+
+  thread_decay_recent_cpu (t);
+  recent_cpu = INT (FMULI (t->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu;
 }
 
 /* Calculates the priority of the given thread using its recent_cpu 
@@ -451,49 +689,85 @@ thread_calculate_priority (struct thread *t)
   return priority;
 }
 
-/* Calculates the recent_cpu of the given thread, returns the value
-  with fixed-point representation */
-static fixed_point
-thread_calculate_recent_cpu (struct thread *t)
+/* Applies to T's recent_cpu the decays of the seconds since it
+  was last decayed.  Interrupts must be off. */
+static void
+thread_decay_recent_cpu (struct thread *t)
 {
-  fixed_point coeff = FDIVF (FMULI (sys_load_avg, 2), 
-                      FADDI (FMULI (sys_load_avg, 2), 1));
-  return FADDI (FMULF (coeff, t->recent_cpu), t->nice);
+  int second = t->decay_seconds;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (decay_seconds - second > DECAY_HISTORY)
+    second = decay_seconds - DECAY_HISTORY;
+  for (; second < decay_seconds; second++)
+    t->recent_cpu = FADDI (FMULF (decay_coeff[second % DECAY_HISTORY],
+                                  t->recent_cpu), t->nice);
+  t->decay_seconds = decay_seconds;
 }
 
-/* Updates the system load average */
+/* Updates the system load average.  IDLE is true if the CPU was
+   idle, which it may be even if the idle thread is not running
+   right now, while catching up with ticks skipped in idle. */
 void 
-update_sys_load_avg (void) 
+update_sys_load_avg (bool idle) 
 {
   /* Ready threads includes the one is currently running except idle */
-  int ready_threads = ready_num;
-  if (thread_current () != idle_thread)
+  int ready_threads = idle ? 0 : ready_num;
+  if (!idle && thread_current () != idle_thread)
     ready_threads += 1;
   sys_load_avg = FMULF (FDIVF (FLOAT (59), FLOAT (60)), sys_load_avg) +
                 FDIVI (FLOAT (ready_threads), 60);
 }
 
-/* Updates all thread's recent_cpu */
+/* Decays recent_cpu, once a second, and recalculates the
+   priority of the threads that can run.  Blocked threads are
+   left to thread_decay_recent_cpu() when they wake up. */
 void
 update_thread_recent_cpu (void)
 {
-  struct list_elem *e = list_begin (&all_list);
-  for (; e != list_end (&all_list); e = list_next (e))
+  struct thread *cur = thread_current ();
+  int priority;
+
+  decay_coeff[decay_seconds % DECAY_HISTORY]
+    = FDIVF (FMULI (sys_load_avg, 2), FADDI (FMULI (sys_load_avg, 2), 1));
+  decay_seconds++;
+
+  if (cur != idle_thread)
     {
-      struct thread *t = list_entry (e, struct thread, allelem);
-      t->recent_cpu = thread_calculate_recent_cpu (t);
+      thread_decay_recent_cpu (cur);
+      cur->priority = thread_calculate_priority (cur);
+      thread_requeue (cur);
+    }
+
+  /* A thread whose priority rose moves to a queue already visited,
+     one whose priority fell is visited again, at no cost. */
+  for (priority = PRI_MAX; priority >= PRI_MIN; priority--)
+    {
+      struct list_elem *e = list_begin (&ready_queues[priority]);
+      while (e != list_end (&ready_queues[priority]))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          e = list_next (e);
+          thread_decay_recent_cpu (t);
+          t->priority = thread_calculate_priority (t);
+          thread_requeue (t);
+        }
     }
 }
 
-/* Updates all thread's priority */
+/* Recalculates the running thread's priority.  Only its
+   recent_cpu changes between decays, so the other threads keep
+   theirs. */
 void 
 update_thread_priority (void)
 {
-  struct list_elem *e = list_begin (&all_list);
-  for (; e != list_end (&all_list); e = list_next (e))
+  struct thread *cur = thread_current ();
+
+  if (cur != idle_thread)
     {
-      struct thread *t = list_entry (e, struct thread, allelem);
-      t->priority = thread_calculate_priority (t);
+      cur->priority = thread_calculate_priority (cur);
+      thread_requeue (cur);
     }
 }
 
@@ -518,6 +792,7 @@ idle (void *idle_started_ UNUSED)
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
+      timer_idle_enter ();
 
       /* Re-enable interrupts and wait for the next one.
 
@@ -581,6 +856,7 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->recent_cpu = 0;
+  t->decay_seconds = decay_seconds;
   if (!thread_mlfqs)
     t->priority = priority;
   else
@@ -592,11 +868,9 @@ init_thread (struct thread *t, const char *name, int priority)
       t->priority = thread_calculate_priority (t);
     }
   t->donatedpriority = PRI_MIN;
-  t->blockedby = NULL;
   t->magic = THREAD_MAGIC;
   t->lock_acquiring = NULL;
-  list_init (&t->holdinglocks);
-  sema_init (&t->sleepsema, 0);
+  heap_init (&t->holdinglocks, lock_priority_higher, NULL);
 
 #ifdef USERPROG
   t->nextfd = 2;
@@ -614,8 +888,6 @@ init_thread (struct thread *t, const char *name, int priority)
 #ifdef FILESYS
   t->pwd = NULL;
 #endif
-
-  list_push_back (&all_list, &t->allelem);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -639,13 +911,160 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
+  struct thread *t;
+
   if (ready_num == 0)
     return idle_thread;
+
+  if (!heap_empty (&dl_ready))
+    t = heap_entry (heap_top (&dl_ready), struct thread, dl_elem);
+  else
+    t = list_entry (list_front (&ready_queues[ready_highest_priority ()]),
+                    struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Appends T to the run queue of its priority, or puts it in
+   dl_ready if it runs by its deadline.  Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  int priority = ready_slot (t);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority == READY_DEADLINE)
+    heap_insert (&dl_ready, &t->dl_elem);
+  else
+    {
+      list_push_back (&ready_queues[priority], &t->elem);
+      ready_bitmap |= (uint64_t) 1 << priority;
+    }
+  t->ready_priority = priority;
+  ready_num += 1;
+}
+
+/* Removes T from its run queue.  Interrupts must be off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->ready_priority == READY_DEADLINE)
+    heap_remove (&dl_ready, &t->dl_elem);
   else
     {
-      ready_num -= 1;
-      return highest_priority_thread (&ready_list, true);
+      list_remove (&t->elem);
+      if (list_empty (&ready_queues[t->ready_priority]))
+        ready_bitmap &= ~((uint64_t) 1 << t->ready_priority);
+    }
+  ready_num -= 1;
+}
+
+/* Returns the run queue T belongs in: READY_DEADLINE or its
+   priority. */
+static int
+ready_slot (struct thread *t)
+{
+  return runs_by_deadline (t) ? READY_DEADLINE : thread_get_priority_thread (t);
+}
+
+/* Returns the highest priority of a ready thread.  There must be
+   one. */
+static int
+ready_highest_priority (void)
+{
+  uint32_t high = ready_bitmap >> 32;
+  uint32_t low = ready_bitmap;
+
+  ASSERT (ready_bitmap != 0);
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  return 31 - __builtin_clz (low);
+}
+
+/* Returns true if T runs by its deadline, that is, it is in the
+   deadline class and has budget left this period. */
+static bool
+runs_by_deadline (const struct thread *t)
+{
+  return t->dl_admitted && !t->dl_throttled;
+}
+
+/* Orders dl_ready by absolute deadline. */
+static bool
+dl_earlier (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, dl_elem);
+  const struct thread *b = heap_entry (b_, struct thread, dl_elem);
+
+  return a->dl_abs_deadline < b->dl_abs_deadline;
+}
+
+/* Starts a period of deadline thread T at tick START: a new
+   deadline and a full budget.  Interrupts must be off. */
+static void
+dl_release (struct thread *t, int64_t start)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->dl_period_idx++;
+  t->dl_abs_deadline = start + t->dl_deadline;
+  t->dl_budget = t->dl_runtime;
+  t->dl_throttled = false;
+  t->dl_job_done = false;
+  timer_add (&t->dl_timer, start + t->dl_period);
+}
+
+/* Timer function that starts the next period of deadline thread
+   T_, waking it up if it waits for it.  The job of the period
+   that ends missed its deadline if it has not finished. */
+static void
+dl_period_start (void *t_)
+{
+  struct thread *t = t_;
+
+  if (!t->dl_job_done)
+    {
+      t->dl_misses++;
+      dl_misses++;
+    }
+  dl_release (t, t->dl_timer.expires);
+
+  /* Its priority matters again once it is throttled.  The loop of
+     update_thread_recent_cpu() does not see dl_ready. */
+  if (thread_mlfqs)
+    {
+      thread_decay_recent_cpu (t);
+      t->priority = thread_calculate_priority (t);
     }
+
+  if (t->dl_waiting)
+    {
+      t->dl_waiting = false;
+      thread_unblock (t);
+    }
+  else
+    thread_requeue (t);
+
+  if (t->status == THREAD_READY && thread_more_urgent (t, thread_current ()))
+    intr_yield_on_return ();
+}
+
+/* Takes T out of the deadline class.  Interrupts must be off. */
+static void
+dl_leave (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  timer_cancel (&t->dl_timer);
+  dl_util -= t->dl_util;
+  t->dl_util = 0;
+  t->dl_admitted = false;
+  t->dl_throttled = false;
+  thread_requeue (t);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -690,7 +1109,13 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (thread_cache_cnt < THREAD_CACHE_MAX)
+        {
+          list_push_front (&thread_cache, &prev->allelem);
+          thread_cache_cnt++;
+        }
+      else
+        palloc_free_page (prev);
     }
 }
 
@@ -712,41 +1137,30 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Bring the timer tick back for the threads to run. */
+  if (cur == idle_thread && next != idle_thread)
+    timer_idle_exit ();
+
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns a tid to use for a new thread.  Interrupts must be
+   off. */
 static tid_t
 allocate_tid (void) 
 {
   static tid_t next_tid = 1;
-  tid_t tid;
-
-  lock_acquire (&tid_lock);
-  tid = next_tid++;
-  lock_release (&tid_lock);
 
-  return tid;
+  ASSERT (intr_get_level () == INTR_OFF);
+  return next_tid++;
 }
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-/* Compares two thread's wakeuptick, used in list_insert_ordered */
-bool 
-thread_wakeuptick_less (const struct list_elem *a,
-                        const struct list_elem *b,
-                        void *aux UNUSED)
-{
-  struct thread *t1 = list_entry (a, struct thread, sleeplistelem);
-  struct thread *t2 = list_entry (b, struct thread, sleeplistelem);
-  
-  return t1->wakeup_tick < t2->wakeup_tick;
-} 
-
 /* Compares two thread's priority, used in list_insert_ordered */
 bool 
 thread_priority_higher (const struct list_elem *a, 
@@ -759,35 +1173,6 @@ thread_priority_higher (const struct list_elem *a,
   return thread_get_priority_thread (t1) > thread_get_priority_thread (t2);
 }
 
-/* Get the thread with highest priority in the given list, if delete is 
- set to true, the thread is removed from the list. */
-struct thread *
-highest_priority_thread (struct list *thread_list, bool delete)
-{
-  struct list_elem *e = list_begin (thread_list);
-  struct list_elem *max_e = e;
-  int max_priority = PRI_MIN;
-  struct thread *highest_priority = list_entry (e, struct thread, elem);
-
-  ASSERT (!list_empty (thread_list));
-
-  for (; e != list_end (thread_list); e = list_next (e))
-    {
-      struct thread *t = list_entry (e, struct thread, elem);
-      int priority = thread_get_priority_thread (t);
-      if (priority > max_priority)
-        {
-          max_priority = priority;
-          highest_priority = t;
-          max_e = e;
-        }
-    }
-  
-  if (delete)
-    list_remove (max_e);
-  return highest_priority;
-}
-
 #ifdef USERPROG
 /* Get the thread with thread tid `threadtid`. Returns NULL on error */
 struct thread *
@@ -903,25 +1288,31 @@ thread_add_mmap (struct thread *t, struct file *fl, void *uaddr, size_t size)
   return mf->mmapid;
 }
 
-/* Remove the memory map relation with mapid. */
-void *
-thread_munmap (struct thread *t, int mmapid, off_t *size, struct file **f)
+/* Get the memory map relation with mapid of thread t, returns NULL
+  if not found. */
+struct mmapfile *
+thread_get_mmap (struct thread *t, int mmapid)
 {
   struct list_elem *e;
-  struct mmapfile *mf = NULL;
-  void *uaddr;
 
   for (e = list_begin (&t->mmap_list); e != list_end (&t->mmap_list);
     e = list_next (e))
     {
-      struct mmapfile *tmp = list_entry (e, struct mmapfile, elem);
-      if (tmp->mmapid == mmapid)
-        {
-          mf = tmp;
-          break;
-        }
+      struct mmapfile *mf = list_entry (e, struct mmapfile, elem);
+      if (mf->mmapid == mmapid)
+        return mf;
     }
-  
+
+  return NULL;
+}
+
+/* Remove the memory map relation with mapid. */
+void *
+thread_munmap (struct thread *t, int mmapid, off_t *size, struct file **f)
+{
+  struct mmapfile *mf = thread_get_mmap (t, mmapid);
+  void *uaddr;
+
   if (mf == NULL)
     return NULL;
   
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include "synch.h"
 #include "fixed-point.h"
+#include "devices/timer.h"
 #include "filesys/file.h"
 
 /* States in a thread's life cycle. */
@@ -26,6 +27,7 @@ typedef int tid_t;
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1) /* Number of priorities. */
 #define NICE_MIN -20                    /* Lowest nice. */
 #define NICE_MAX 20                     /* Highest nice. */
 
@@ -112,23 +114,43 @@ struct thread
     int priority;                       /* Original priority. */
     int donatedpriority;                /* Priority donated by other threads */
     struct list_elem allelem;           /* List element for all threads list. */
-    struct list_elem sleeplistelem;     /* List element for sleeping list. */
-    int64_t wakeup_tick;                /* The tick the thread wake up. */
-    struct semaphore sleepsema;         /* Semaphore for blocking thread. */
-    struct thread *blockedby;           /* The thread holding resources acquired by this thread. */
-    struct list holdinglocks;           /* Locks holding by the thread. */
+    struct heap holdinglocks;           /* Locks held, by waiter priority. */
     struct lock *lock_acquiring;        /* The lock that the thread is acquiring. */
     
     /* 4.4BSD Scheduler */
     int nice;                           /* Niceness of the thread */
     fixed_point recent_cpu;             /* recent_cpu of the thread */
+    int decay_seconds;                  /* Decays applied to recent_cpu. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    int ready_priority;                 /* Run queue, when ready. */
+    struct heap_elem waitelem;          /* Semaphore wait queue element. */
+    unsigned wait_seq;                  /* Arrival in the wait queue. */
+    struct heap *wait_heap;             /* Wait queue to requeue in. */
+    struct heap_elem *wait_heap_elem;   /* This thread's element in it. */
+
+    /* Deadline scheduling class, owned by thread.c. */
+    bool dl_admitted;                   /* In the deadline class? */
+    bool dl_throttled;                  /* Budget used up this period? */
+    bool dl_job_done;                   /* Job of this period finished? */
+    bool dl_waiting;                    /* In thread_wait_period()? */
+    int64_t dl_runtime;                 /* Ticks of CPU per period. */
+    int64_t dl_period;                  /* Ticks between releases. */
+    int64_t dl_deadline;                /* Ticks from release to deadline. */
+    int dl_util;                        /* Admitted CPU share, in 1/1000s. */
+    int64_t dl_abs_deadline;            /* Deadline of the current job. */
+    int64_t dl_budget;                  /* Ticks left this period. */
+    int dl_misses;                      /* Jobs that missed the deadline. */
+    unsigned dl_period_idx;             /* Periods released so far. */
+    unsigned dl_job_idx;                /* Period of the running job. */
+    struct heap_elem dl_elem;           /* Deadline run queue element. */
+    struct timer dl_timer;              /* Starts the next period. */
     
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct pagedir_batch *pd_batch;     /* Deferred TLB invalidations. */
     
     /* File descriptors opened by the thread. */
     struct list openfds;
@@ -176,6 +198,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -200,6 +223,14 @@ int thread_get_priority (void);
 void thread_set_priority (int);
 void thread_set_donatedpriority (int);
 int thread_get_priority_thread (struct thread *t);
+void thread_requeue (struct thread *t);
+bool thread_more_urgent (struct thread *a, struct thread *b);
+
+/* Deadline (EDF) scheduling */
+bool thread_set_deadline (int64_t runtime, int64_t period, int64_t deadline);
+void thread_clear_deadline (void);
+void thread_wait_period (void);
+int thread_get_deadline_misses (void);
 
 /* mlfqs scheduling */
 int thread_get_nice (void);
@@ -207,21 +238,14 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-void update_sys_load_avg (void);
+void update_sys_load_avg (bool idle);
 void update_thread_recent_cpu (void);
 void update_thread_priority (void);
 
 /* Utils for list container */
-bool thread_wakeuptick_less (const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux UNUSED);
-
 bool thread_priority_higher (const struct list_elem *a, 
                              const struct list_elem *b, 
                              void *aux UNUSED);
-                           
-struct thread *highest_priority_thread (struct list *thread_list,
-                                                       bool delete);
 
 struct thread *get_child_thread (struct thread *t, tid_t threadtid);
 void remove_child_thread (struct thread *t, tid_t threadtid);
@@ -237,6 +261,7 @@ bool is_thread (struct thread *);
 
 /* memory map management */
 int thread_add_mmap (struct thread *t, struct file *fl, void *uaddr, size_t size);
+struct mmapfile *thread_get_mmap (struct thread *t, int mmapid);
 void *thread_munmap (struct thread *t, int mmapid, off_t *size, struct file **f);
 void thread_munmap_all (struct thread *t);
 
@@ -0,0 +1,222 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Work is done by a pool of kernel threads, the workers, which
+   take it first come, first served from work_list.  Unlike an
+   interrupt handler, a work function runs in a thread of its own,
+   so it may sleep, take locks and do I/O. */
+#define WORKER_CNT 3
+static struct list work_list;
+
+/* Up'd once for every work queued. */
+static struct semaphore work_sema;
+
+/* Bottom halves raised by interrupt handlers.  They run on the
+   return of the interrupt, after the PIC is acknowledged, with
+   interrupts on.  Like the handlers, they must not sleep. */
+static struct list softirq_list;
+
+/* Statistics. */
+static long long work_cnt;      /* # of work functions run. */
+static long long softirq_cnt;   /* # of bottom halves run. */
+
+static thread_func worker;
+static timer_func delayed_work_fire;
+
+/* Initializes the work lists.  Must be called before interrupts
+   are turned on. */
+void
+workqueue_init (void)
+{
+  list_init (&work_list);
+  list_init (&softirq_list);
+  sema_init (&work_sema, 0);
+}
+
+/* Starts the worker threads. */
+void
+workqueue_start (void)
+{
+  int i;
+
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "worker%d", i);
+      thread_create (name, PRI_DEFAULT, worker, NULL);
+    }
+}
+
+/* Initializes W to call FUNC (AUX) when it is done. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  w->func = func;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Queues W for a worker thread.  Returns false if W is already
+   queued, true otherwise.  W may be queued again once its
+   function has started.  May be called from an interrupt
+   handler. */
+bool
+work_queue (struct work *w)
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = !w->pending;
+
+  if (queued)
+    {
+      w->pending = true;
+      list_push_back (&work_list, &w->elem);
+      sema_up (&work_sema);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Takes W off its queue.  Returns true if it was queued, false if
+   it has already started or was never queued. */
+bool
+work_cancel (struct work *w)
+{
+  enum intr_level old_level = intr_disable ();
+  bool pending = w->pending;
+
+  if (pending)
+    {
+      list_remove (&w->elem);
+      w->pending = false;
+    }
+  intr_set_level (old_level);
+  return pending;
+}
+
+/* Initializes DW to call FUNC (AUX) when it is done. */
+void
+delayed_work_init (struct delayed_work *dw, work_func *func, void *aux)
+{
+  work_init (&dw->work, func, aux);
+  timer_setup (&dw->timer, delayed_work_fire, dw);
+}
+
+/* Queues DW for a worker thread in TICKS timer ticks.  Returns
+   false if DW is already waiting or queued, true otherwise.  May
+   be called from an interrupt handler. */
+bool
+work_queue_delayed (struct delayed_work *dw, int64_t ticks)
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = !dw->timer.pending && !dw->work.pending;
+
+  if (queued)
+    timer_add (&dw->timer, timer_ticks () + ticks);
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Takes DW off its timer or its queue.  Returns true if it was
+   waiting or queued, false otherwise. */
+bool
+delayed_work_cancel (struct delayed_work *dw)
+{
+  return timer_cancel (&dw->timer) || work_cancel (&dw->work);
+}
+
+/* Timer function of delayed work. */
+static void
+delayed_work_fire (void *dw_)
+{
+  struct delayed_work *dw = dw_;
+  work_queue (&dw->work);
+}
+
+/* Raises the bottom half W, to be run on the return of the
+   current interrupt, or of the next one if not called from an
+   interrupt handler.  Returns false if W is already raised, true
+   otherwise. */
+bool
+softirq_raise (struct work *w)
+{
+  enum intr_level old_level = intr_disable ();
+  bool raised = !w->pending;
+
+  if (raised)
+    {
+      w->pending = true;
+      list_push_back (&softirq_list, &w->elem);
+    }
+  intr_set_level (old_level);
+  return raised;
+}
+
+/* Returns true if there are bottom halves to run.  Interrupts
+   must be off. */
+bool
+softirq_pending (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return !list_empty (&softirq_list);
+}
+
+/* Runs the raised bottom halves, including those raised while
+   they run.  Called by intr_handler() with interrupts on. */
+void
+softirq_run (void)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct work *w = NULL;
+
+      if (!list_empty (&softirq_list))
+        {
+          w = list_entry (list_pop_front (&softirq_list), struct work, elem);
+          w->pending = false;
+          softirq_cnt++;
+        }
+      intr_set_level (old_level);
+
+      if (w == NULL)
+        break;
+      w->func (w->aux);
+    }
+}
+
+/* Prints work queue statistics. */
+void
+workqueue_print_stats (void)
+{
+  printf ("Workqueue: %lld work functions, %lld bottom halves run\n",
+          work_cnt, softirq_cnt);
+}
+
+/* A worker thread, does the queued work. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w = NULL;
+
+      sema_down (&work_sema);
+      old_level = intr_disable ();
+      /* Cancelled work leaves its up behind. */
+      if (!list_empty (&work_list))
+        {
+          w = list_entry (list_pop_front (&work_list), struct work, elem);
+          w->pending = false;
+          work_cnt++;
+        }
+      intr_set_level (old_level);
+
+      if (w != NULL)
+        w->func (w->aux);
+    }
+}
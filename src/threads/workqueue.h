@@ -0,0 +1,44 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* A piece of work to be done later, by calling FUNC (AUX). */
+typedef void work_func (void *aux);
+struct work
+  {
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Its argument. */
+    bool pending;               /* Queued and not started yet. */
+    struct list_elem elem;      /* Element in a work list. */
+  };
+
+/* Work queued after a delay. */
+struct delayed_work
+  {
+    struct work work;           /* The work. */
+    struct timer timer;         /* Queues it when it fires. */
+  };
+
+void workqueue_init (void);
+void workqueue_start (void);
+
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct work *);
+bool work_cancel (struct work *);
+
+void delayed_work_init (struct delayed_work *, work_func *, void *aux);
+bool work_queue_delayed (struct delayed_work *, int64_t ticks);
+bool delayed_work_cancel (struct delayed_work *);
+
+/* Bottom halves of interrupt handlers. */
+bool softirq_raise (struct work *);
+bool softirq_pending (void);
+void softirq_run (void);
+
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
@@ -11,6 +11,25 @@
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of page faults that loaded a page and the CPU cycles
+   spent on them. */
+static long long page_load_cnt;
+static uint64_t page_load_cycles;
+
+/* Number of pages mapped ahead of the faulting page. */
+static long long page_around_cnt;
+
+/* Number of read faults that mapped the zero frame. */
+static long long page_zero_cnt;
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -68,6 +87,13 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  if (page_load_cnt > 0)
+    printf ("Exception: %lld pages loaded, %"PRIu64" cycles each\n",
+            page_load_cnt, page_load_cycles / page_load_cnt);
+  if (page_around_cnt > 0)
+    printf ("Exception: %lld pages mapped around faults\n", page_around_cnt);
+  if (page_zero_cnt > 0)
+    printf ("Exception: %lld faults mapped the zero page\n", page_zero_cnt);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -131,6 +157,7 @@ page_fault (struct intr_frame *f)
   uint32_t fault_addr;  /* Fault address. */
   void *fault_page;
   bool is_valid_stack;
+  uint64_t start;       /* TSC when the fault was taken. */
   struct thread *t = thread_current ();
 
   /* Obtain faulting address, the virtual address that was
@@ -148,6 +175,7 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  start = rdtsc ();
 
   // printf ("in page fault %d\n", thread_current ()->tid);
 
@@ -171,15 +199,36 @@ page_fault (struct intr_frame *f)
   if (is_valid_stack && !supt_contains (t->supt, fault_page))
     supt_install_page (t->supt, fault_page, NULL, PG_ZERO); 
   
+  /* A write to the zero page gets a page of its own below. */
+  if (!not_present && write && is_user_vaddr (fault_page)
+        && supt_unmap_zero (t->supt, fault_page))
+    not_present = true;
+
+  /* Reading a page never written maps the zero frame. */
+  if (not_present && !write && is_user_vaddr (fault_page)
+        && supt_map_zero (t->supt, fault_page))
+    {
+      page_zero_cnt++;
+      return;
+    }
+
   if (not_present && is_user_vaddr (fault_page) 
         && supt_load_page (t->supt, fault_page))
     {
       supt_unlock_mem (t->supt, fault_page, 0);
+      page_around_cnt += supt_fault_around (t->supt, fault_page);
+      page_load_cnt++;
+      page_load_cycles += rdtsc () - start;
       // printf ("out page fault %d\n", thread_current ()->tid);
 
       return;
     }
   // printf ("out page fault %d\n", thread_current ()->tid);
+
+  /* Write to a page shared copy on write after a fork. */
+  if (!not_present && write && is_user_vaddr (fault_page)
+        && supt_break_cow (t->supt, fault_page, false))
+    return;
   
   if (not_present || (is_kernel_vaddr (fault_page) && user) || write)
     exit (-1);
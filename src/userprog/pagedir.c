@@ -5,9 +5,12 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void invalidate_all (void);
+static void batch_add (struct pagedir_batch *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -80,6 +83,11 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* A large kernel page has no page table.  Frames of the user
+     pool are never mapped that way, see paging_init(). */
+  if (*pde & PTE_PS)
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -152,7 +160,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,11 +188,28 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Makes the mapping of user virtual page UPAGE in PD writable
+   if WRITABLE is true, read-only otherwise.  UPAGE need not be
+   mapped. */
+void
+pagedir_set_writable (uint32_t *pd, const void *upage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, upage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -209,7 +234,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -222,6 +247,11 @@ pagedir_activate (uint32_t *pd)
   if (pd == NULL)
     pd = init_page_dir;
 
+  /* Switching between threads of the same page directory, reloading
+     CR3 would only flush the TLB. */
+  if (active_pd () == pd)
+    return;
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -243,21 +273,102 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Starts a batch of page table changes in the current thread.
+   Until the matching pagedir_batch_end(), the TLB entries they
+   make stale are only recorded in BATCH, then invalidated
+   together, or by a single flush if there are too many.  Batches
+   may nest, an inner batch hands its pages to the outer one. */
+void
+pagedir_batch_begin (struct pagedir_batch *batch)
+{
+  struct thread *t = thread_current ();
+
+  batch->cnt = 0;
+  batch->outer = t->pd_batch;
+  t->pd_batch = batch;
+}
+
+/* Ends BATCH and invalidates the TLB entries recorded in it. */
+void
+pagedir_batch_end (struct pagedir_batch *batch)
+{
+  struct thread *t = thread_current ();
+  struct pagedir_batch *outer = batch->outer;
+  size_t i;
+
+  ASSERT (t->pd_batch == batch);
+  t->pd_batch = outer;
+
+  if (outer != NULL)
+    {
+      if (batch->cnt > PAGEDIR_BATCH_MAX)
+        outer->cnt = PAGEDIR_BATCH_MAX + 1;
+      else
+        for (i = 0; i < batch->cnt; i++)
+          batch_add (outer, batch->pages[i]);
+      return;
+    }
+
+  if (batch->cnt > PAGEDIR_BATCH_MAX)
+    invalidate_all ();
+  else
+    for (i = 0; i < batch->cnt; i++)
+      asm volatile ("invlpg (%0)" : : "r" (batch->pages[i]) : "memory");
+}
+
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry of the page, with INVLPG.  See [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)".
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the entry of VADDR if PD is the
+   active page directory.  (If PD is not active then its user
+   entries are not in the TLB, so there is no need to invalidate
+   anything.  Kernel mappings are the same in every page
+   directory.)  Inside a batch, the invalidation is deferred to
+   pagedir_batch_end(). */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vaddr) 
 {
-  if (active_pd () == pd) 
+  struct pagedir_batch *batch;
+
+  if (is_user_vaddr (vaddr) && active_pd () != pd)
+    return;
+
+  batch = thread_current ()->pd_batch;
+  if (batch != NULL)
+    batch_add (batch, vaddr);
+  else
+    asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
+
+/* Records VADDR in BATCH.  Past PAGEDIR_BATCH_MAX pages, the batch
+   just remembers that it overflowed: the whole TLB is flushed at
+   the end. */
+static void
+batch_add (struct pagedir_batch *batch, const void *vaddr)
+{
+  if (batch->cnt < PAGEDIR_BATCH_MAX)
+    batch->pages[batch->cnt++] = vaddr;
+  else
+    batch->cnt = PAGEDIR_BATCH_MAX + 1;
+}
+
+/* Flushes the whole TLB.  Reloading CR3 leaves global pages in
+   it, toggling CR4_PGE flushes them too.  See [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)". */
+static void
+invalidate_all (void) 
+{
+  uint32_t cr4;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (cr4 & CR4_PGE)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 & ~CR4_PGE) : "memory");
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+    }
+  else
+    asm volatile ("movl %0, %%cr3" : : "r" (vtop (active_pd ())) : "memory");
 }
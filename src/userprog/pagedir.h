@@ -2,8 +2,22 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most TLB entries a batch invalidates one by one.  Past that, the
+   whole TLB is flushed. */
+#define PAGEDIR_BATCH_MAX 32
+
+/* Page table changes whose TLB invalidations are deferred, see
+   pagedir_batch_begin(). */
+struct pagedir_batch
+  {
+    size_t cnt;                         /* Pages, > MAX if overflowed. */
+    const void *pages[PAGEDIR_BATCH_MAX];
+    struct pagedir_batch *outer;        /* Enclosing batch or NULL. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -13,6 +27,9 @@ bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 void pagedir_activate (uint32_t *pd);
+void pagedir_batch_begin (struct pagedir_batch *batch);
+void pagedir_batch_end (struct pagedir_batch *batch);
 
 #endif /* userprog/pagedir.h */
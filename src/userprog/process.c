@@ -22,11 +22,11 @@
 #include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static void clear_children_parent (struct thread *t);
 
 extern struct lock file_lock;
-extern struct lock frame_lock;
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -156,12 +156,6 @@ start_process (void *file_name_)
     t->pwd = dir_open_root ();
 #endif
 
-  /* Deny write for the elf file. */
-  lock_acquire (&file_lock);
-  t->elf = filesys_open (file_name);
-  file_deny_write (t->elf);
-  lock_release (&file_lock);
-
   palloc_free_page (buf);
   palloc_free_page (file_name_);
 
@@ -175,6 +169,119 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Passed from process_fork() to the child, lives on the parent's
+   stack until the child has been set up. */
+struct fork_args
+  {
+    struct thread *parent;
+    struct intr_frame *if_;             /* Parent's user registers. */
+  };
+
+/* Creates a copy of the current process, which returns to user mode
+   from the same system call as the parent, with the registers in
+   IF_.  The pages of the parent are shared copy on write.  Returns
+   the thread id of the child, or TID_ERROR if it cannot be created.
+   Memory mapped files are not inherited. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct fork_args args;
+  struct thread *cur = thread_current ();
+  struct thread *t;
+  tid_t tid;
+
+  args.parent = cur;
+  args.if_ = if_;
+  tid = thread_create (cur->name, cur->priority, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* Wait to see if the child is copied properly */
+  t = get_child_thread (cur, tid);
+  sema_down (&t->wait_load);
+  if (!t->load_success)
+    {
+      remove_child_thread (cur, tid);
+      tid = TID_ERROR;
+    }
+
+  return tid;
+}
+
+/* Duplicates the open files of thread FROM into thread TO, keeping
+   their descriptors.  file_lock must be held. */
+static bool
+fork_files (struct thread *from, struct thread *to)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&from->openfds); e != list_end (&from->openfds);
+       e = list_next (e))
+    {
+      struct filefd *ffd = list_entry (e, struct filefd, elem);
+      struct filefd *copy = malloc (sizeof *copy);
+      
+      if (!copy)
+        return false;
+      copy->f = file_reopen (ffd->f);
+      if (!copy->f)
+        {
+          free (copy);
+          return false;
+        }
+      file_seek (copy->f, file_tell (ffd->f));
+      copy->fd = ffd->fd;
+      list_push_back (&to->openfds, &copy->elem);
+    }
+  to->nextfd = from->nextfd;
+  return true;
+}
+
+/* A thread function that copies the parent process and returns to
+   user mode as the child of fork(). */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *parent = args->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = *args->if_;
+  bool success = false;
+
+  t->pagedir = pagedir_create ();
+  t->supt = supt_create ();
+  if (t->pagedir == NULL || t->supt == NULL)
+    goto done;
+  process_activate ();
+
+  lock_acquire (&file_lock);
+  t->elf = file_reopen (parent->elf);
+  if (t->elf)
+    file_deny_write (t->elf);
+  success = t->elf && fork_files (parent, t);
+  lock_release (&file_lock);
+
+  success = success && supt_fork (parent, t);
+
+#ifdef FILESYS
+  if (parent->pwd)
+    t->pwd = dir_reopen (parent->pwd);
+  else 
+    t->pwd = dir_open_root ();
+#endif
+
+ done:
+  t->load_success = success;
+  sema_up (&t->wait_load);
+  if (!success)
+    thread_exit ();
+
+  /* The child sees 0 returned from fork(). */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -229,6 +336,23 @@ process_exit (void)
   /* Unmap all the memory map areas */
   thread_munmap_all (cur);
 
+  /* The order of destroying supt and pagedir is crucial. 
+    This function will destroy the supt of the thread and 
+    also delete all the frame entries owned by the thread.
+    If this line is below the pagedir_destroy, there are 
+    some synchronization problems. If there is an interrupt
+    and switch to another thread which is acquiring memory, 
+    it may get a existing kaddr in frame table from palloc.
+    A child of fork may have failed to create it. */
+  if (cur->supt != NULL)
+    {
+      supt_destroy (cur->supt, cur->pagedir);
+      cur->supt = NULL;
+    }
+
+  /* Only now that no page refers to the executable and its shared
+    frames are dropped, it can be closed: its inode could be reused
+    by another executable otherwise. */
   if (cur->elf)
     {
       /* When page fault at reading filename, 
@@ -240,16 +364,6 @@ process_exit (void)
       lock_release (&file_lock);
     }
 
-  /* The order of destroying supt and pagedir is crucial. 
-    This function will destroy the supt of the thread and 
-    also delete all the frame entries owned by the thread.
-    If this line is below the pagedir_destroy, there are 
-    some synchronization problems. If there is an interrupt
-    and switch to another thread which is acquiring memory, 
-    it may get a existing kaddr in frame table from palloc. */
-  supt_destroy (cur->supt, cur->pagedir);
-  cur->supt = NULL;
-
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -479,16 +593,22 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   success = true;
 
+  /* Keep the executable open while the process runs, its pages are
+     loaded on demand from it.  Deny writes to it meanwhile. */
+  lock_acquire (&file_lock);
+  file_deny_write (file);
+  lock_release (&file_lock);
+  t->elf = file;
+
  done:
   /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  if (!success)
+    file_close (file);
   return success;
 }
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -556,7 +676,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -567,39 +686,21 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 
       /* Lazy load all zero bytes */
       if (page_read_bytes == 0)
-          supt_install_page (thread_current ()->supt, upage, NULL, PG_ZERO);
-      else 
         {
-          /* Get a page of memory. */
-          uint8_t *kpage = frame_get_page (upage, PAL_USER);
-          if (kpage == NULL)
+          if (!supt_install_page (thread_current ()->supt, upage, NULL,
+                                  PG_ZERO))
             return false;
-
-          /* Load this page. */
-          if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-            {
-              frame_free_page (kpage);
-              return false; 
-            }
-          memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-          /* Add the page to the process's address space. */
-          if (!install_page (upage, kpage, writable)) 
-            {
-              frame_free_page (kpage);
-              return false; 
-            }
-          
-          /* Avoid the frame to be evicted before installed to supt */
-          lock_acquire (&frame_lock);
-          frame_set_unlocked (kpage);
-          lock_release (&frame_lock);
         }
+      /* Lazy load the rest from the executable, on first fault. */
+      else if (!supt_install_execmap (thread_current ()->supt, upage, file,
+                                      ofs, page_read_bytes, writable))
+        return false;
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
+      ofs += PGSIZE;
     }
   return true;
 }
@@ -620,28 +721,6 @@ setup_stack (void **esp)
   return success;
 }
 
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
-{
-  struct thread *t = thread_current ();
-
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable))
-          && supt_install_page (t->supt, upage, kpage, PG_IN_MEM);
-}
-
-
 /* Set all children's parent to NULL. If a child is exited, unblock it. */
 static void
 clear_children_parent (struct thread *t)
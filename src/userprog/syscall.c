@@ -10,6 +10,10 @@
   in /lib/user/syscall.h */
 #define READDIR_MAX_LEN 14
 
+/* Flags of msync, synched with lib/user/syscall.h too. */
+#define MS_ASYNC 1
+#define MS_SYNC 4
+
 static void syscall_handler (struct intr_frame *f);
 
 static syscall syscall_vec[SYSCALLNUM];
@@ -53,6 +57,8 @@ syscall_init (void)
   syscall_vec[SYS_READDIR ] = syscall_readdir;/* Reads a directory entry. */
   syscall_vec[SYS_ISDIR   ] = syscall_isdir;   /* Tests if a fd represents a directory. */
   syscall_vec[SYS_INUMBER ] = syscall_inumber; /* Returns the inode number for a fd. */
+  syscall_vec[SYS_FORK    ] = syscall_fork;    /* Duplicate the process. */
+  syscall_vec[SYS_MSYNC   ] = syscall_msync;   /* Write back a memory map. */
 }
 
 /* Entry of system call. */
@@ -213,6 +219,11 @@ syscall_read (int *esp)
   
   if (!is_user_vaddr (buffer) || !is_user_vaddr (buffer + len))
     exit (-1);
+
+  /* The kernel ignores read-only mappings, a read into a code page
+    would otherwise change it, for every process sharing it. */
+  if (!supt_check_writable (thread_current ()->supt, buffer, len))
+    exit (-1);
   
   if (fd == 0)
     {
@@ -227,7 +238,7 @@ syscall_read (int *esp)
         return retval;
       
       /* Get the memory area needed in read in advance */
-      if (!supt_preload_mem (thread_current ()->supt, buffer, esp, len))
+      if (!supt_preload_mem (thread_current ()->supt, buffer, esp, len, true))
         exit(-1);
       lock_acquire (&file_lock);
       retval = file_read (fl, buffer, len);
@@ -258,7 +269,7 @@ syscall_write (int *esp)
       if (!fl || !inode_is_file (file_get_inode (fl)))
         return retval;
       /* Get the memory area needed in write in advance */
-      if (!supt_preload_mem (thread_current ()->supt, buffer, esp, len))
+      if (!supt_preload_mem (thread_current ()->supt, buffer, esp, len, false))
         exit(-1);
       lock_acquire (&file_lock);
       retval = file_write (fl, buffer, len);
@@ -419,6 +430,27 @@ syscall_munmap (int *esp)
   return 0;
 }
 
+/* System call for writing back the dirty pages of a memory map.
+  With MS_ASYNC the flush work is only queued to do it. */
+uint32_t
+syscall_msync (int *esp)
+{
+  int mapid = ARG1 (esp);
+  int flags = ARG2 (esp);
+  struct thread *cur = thread_current ();
+  struct mmapfile *mf = thread_get_mmap (cur, mapid);
+
+  if (!mf || (flags != MS_ASYNC && flags != MS_SYNC))
+    return -1;
+
+  /* Pages mapped from the page cache are only marked dirty there
+     by MS_ASYNC, the flusher writes them back with the frames. */
+  supt_msync (cur->supt, mf->uaddr, mf->size, flags == MS_SYNC);
+  if (flags == MS_ASYNC)
+    frame_flush_async ();
+  return 0;
+}
+
 /* change directory */
 uint32_t 
 syscall_chdir (int *esp)
@@ -478,3 +510,13 @@ syscall_inumber (int *esp)
 
   return inode_get_inumber (file_get_inode (fl));
 }
+
+/* System call for fork. The user registers of the caller are in the
+  interrupt frame at the top of its kernel stack. */
+uint32_t
+syscall_fork (int *esp UNUSED)
+{
+  struct intr_frame *f = ((struct intr_frame *) 
+                          ((uint8_t *) thread_current () + PGSIZE)) - 1;
+  return process_fork (f);
+}
@@ -16,7 +16,7 @@
 #include "filesys/off_t.h"
 #include "filesys/directory.h"
 
-#define SYSCALLNUM 20
+#define SYSCALLNUM 22
 /* Used in process.c when process exit */
 void close_all_file (struct thread *t);
 void exit (int status);
@@ -45,5 +45,7 @@ uint32_t syscall_mkdir (int *);
 uint32_t syscall_readdir (int *);
 uint32_t syscall_isdir (int *);  
 uint32_t syscall_inumber (int *);
+uint32_t syscall_fork (int *);
+uint32_t syscall_msync (int *);
 
 #endif /* userprog/syscall.h */
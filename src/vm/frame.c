@@ -1,16 +1,28 @@
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/swap.h"
 #include "userprog/pagedir.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/pte.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "filesys/pagecache.h"
 #include <stdio.h>
+#include <string.h>
 
-/* Lock to keep data structures synchonized. 
-  Users: frame.c page.c process.c */
-struct lock frame_lock;
+/* Lock to keep the frame table, the clock list and the pin bit of
+  every frame synchronized.  It is only held for short sections and
+  never across disk I/O.
+
+  Lock ordering: a supt_lock may be held when acquiring frame_lock.
+  While holding frame_lock, a supt_lock may only be taken with
+  lock_try_acquire, so the two orders can never deadlock. */
+static struct lock frame_lock;
 
 /* An hash table with key=kaddr, v=frame_entry. */
 static struct hash frame_table;
@@ -19,6 +31,65 @@ static struct hash frame_table;
 static struct list frame_list;
 static struct list_elem *clock = NULL;
 
+/* A kernel page of zeroes, mapped read-only by frame_zero_page users. */
+static void *zero_frame;
+
+/* If true, dirty frames ahead of the clock hand are written back by
+  the cleaner work, so the eviction finds clean victims.
+  Controlled by kernel command-line option "-async-clean". */
+bool frame_async_clean;
+
+/* Queued when the clock hand has to skip dirty frames. */
+static struct work clean_work;
+
+/* Number of frames scanned and cleaned ahead of the clock hand
+  each time the cleaner runs. */
+#define CLEAN_SCAN 64
+#define CLEAN_BATCH 8
+
+/* Free user frame watermarks, in pages.  The pageout work is queued
+  when the number of free frames drops below frame_low_wm, and
+  evicts frames until there are frame_high_wm free ones.
+  Controlled by kernel command-line options "-pageout-low" and
+  "-pageout-high", 0 for a default relative to the user pool size. */
+size_t frame_low_wm;
+size_t frame_high_wm;
+
+static struct work pageout_work;
+static bool pageout_active;
+
+/* Dirty pages of memory mapped files are written back in the
+  background by the flush work.  It runs about every
+  FLUSH_INTERVAL ticks while frames are being allocated, and when an
+  asynchronous msync asks for it. */
+#define FLUSH_INTERVAL (TIMER_FREQ / 2)
+
+static struct work flush_work;
+static int64_t flush_last;
+
+/* Statistics. */
+static long long evict_cnt;         /* # of frames evicted. */
+static long long evict_dirty_cnt;   /* # of evicted frames written back. */
+static long long clean_cnt;         /* # of frames cleaned in advance. */
+static long long direct_reclaim_cnt;  /* # of frames evicted on a fault. */
+static long long pageout_reclaim_cnt; /* # of frames freed by pageout. */
+static long long pageout_wakeup_cnt;  /* # of times pageout woke up. */
+static long long share_hit_cnt;       /* # of faults on a shared frame. */
+static long long cow_fault_cnt;       /* # of copy on write faults. */
+static long long cow_copy_cnt;        /* # of them that copied a page. */
+static long long flush_cnt;           /* # of mapped pages flushed. */
+
+/* Shared frames, with key=(inode, ofs), v=frame_entry. */
+static struct hash share_table;
+
+/* Page cache pages mapped into memory mapped files, in clock order.
+  They are in frame_table, so they are pinned like frames, but not
+  in frame_list: they are not user frames.  When the page cache
+  cannot map another page, the coldest one is unmapped from every
+  process instead, see frame_get_cached. */
+static struct list cache_list;
+static long long cache_unmap_cnt;     /* # of cache pages unmapped. */
+
 /* Entry struct of frame table. */
 struct frame_entry
   {
@@ -28,23 +99,62 @@ struct frame_entry
     /* Owner thread */
     struct thread *t;
 
-    /* If locked, cannot be evicted */
-    bool locked;
+    /* If pinned, cannot be evicted.  A frame is pinned while it is
+      being loaded, while it is used by a system call and while it is
+      being evicted.  A shared frame may be pinned by several
+      processes, so this is a count. */
+    unsigned pin_cnt;
+
+    /* A shared frame holds the read-only page at offset OFS of INODE
+      and is mapped by every process in MAPPINGS, T and UADDR are
+      unused then.  INODE is NULL for a private frame. */
+    struct inode *inode;
+    off_t ofs;
+    struct list mappings;
+    struct hash_elem share_elem;
+
+    /* A copy on write frame is private memory shared by the processes
+      in MAPPINGS after a fork, until they write to it.  T and UADDR
+      are unused then too. */
+    bool cow;
+
+    /* If true, an identical copy of the page is kept in its swap slot
+      or its file, so the frame can be evicted without a write as long
+      as it is not dirty. */
+    bool backed;
+
+    /* The frame holds a page of a memory mapped file, written back by
+      the flush work when it is dirty. */
+    bool mmapped;
+
+    /* The frame is a page cache page, of page OFS of INODE, mapped
+      by every process in MAPPINGS.  It is in cache_list. */
+    bool cached;
 
     struct hash_elem elem;
     struct list_elem listelem;
   };
 
+/* A mapping of a shared frame, the reverse map from the frame to
+  the page tables that map it. */
+struct frame_mapping
+  {
+    struct thread *t;
+    void *uaddr;
+    bool locked;            /* supt_lock of T acquired by the evictor. */
+    struct list_elem elem;
+  };
+
 /* Hash function for frame_entry, since the kaddr is often different, we
   just use it as the hash value. */
-static unsigned 
+static unsigned
 entry_hash (const struct hash_elem *e, void *aux UNUSED)
 {
   struct frame_entry *entry = hash_entry (e, struct frame_entry, elem);
   return (unsigned) entry->kaddr;
 }
 
-static bool 
+static bool
 entry_less (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
 {
   struct frame_entry *e1 = hash_entry (a, struct frame_entry, elem);
@@ -52,59 +162,131 @@ entry_less (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUS
   return e1->kaddr < e2->kaddr;
 }
 
-static struct frame_entry *frame_select_eviction (void);
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct frame_entry *entry = hash_entry (e, struct frame_entry, share_elem);
+  return hash_int ((int) entry->inode ^ entry->ofs);
+}
+
+static bool
+share_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  struct frame_entry *e1 = hash_entry (a, struct frame_entry, share_elem);
+  struct frame_entry *e2 = hash_entry (b, struct frame_entry, share_elem);
+  if (e1->inode != e2->inode)
+    return e1->inode < e2->inode;
+  return e1->ofs < e2->ofs;
+}
+
+static struct frame_entry *frame_select_eviction (bool *supt_locked);
+static bool frame_is_shared (struct frame_entry *entry);
+static bool frame_is_accessed (struct frame_entry *entry);
+static void frame_clear_accessed (struct frame_entry *entry);
+static bool frame_lock_mappers (struct frame_entry *entry);
+static void frame_unmap_shared (struct frame_entry *entry,
+                                struct list *locked);
+static void frame_unlock_mappers (struct list *locked);
+static bool frame_evict_cached (void);
+static struct frame_entry *share_find (struct inode *inode, off_t ofs);
+static bool frame_lock_owner (struct frame_entry *entry, bool *supt_locked);
+static bool frame_lock_owner_of (struct thread *t, bool *supt_locked);
+static bool frame_needs_write (struct frame_entry *entry);
+static struct frame_entry *frame_evict (void);
+static void pageout_check (void);
+static work_func frame_pageout;
+static size_t frame_evict_batch (void);
+static work_func frame_cleaner;
+static void frame_clean_ahead (void);
+static work_func frame_flusher;
+static void frame_flush (void);
 static void next_clock (void);
 
 /* Initialize the frame table. */
-void 
-frame_init (void) 
+void
+frame_init (void)
 {
+  zero_frame = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   lock_init (&frame_lock);
   hash_init (&frame_table, entry_hash, entry_less, NULL);
+  hash_init (&share_table, share_hash, share_less, NULL);
   list_init (&frame_list);
+  list_init (&cache_list);
+  work_init (&clean_work, frame_cleaner, NULL);
+  work_init (&flush_work, frame_flusher, NULL);
+  work_init (&pageout_work, frame_pageout, NULL);
+
+  if (frame_low_wm == 0)
+    frame_low_wm = palloc_user_page_cnt () / 32 + 1;
+  if (frame_high_wm <= frame_low_wm)
+    frame_high_wm = frame_low_wm * 2;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %lld evictions, %lld written back, %lld cleaned\n",
+          evict_cnt, evict_dirty_cnt, clean_cnt);
+  printf ("Frame: watermarks %zu/%zu, %lld pageout wakeups, "
+          "%lld pages reclaimed by pageout, %lld on fault\n",
+          frame_low_wm, frame_high_wm, pageout_wakeup_cnt,
+          pageout_reclaim_cnt, direct_reclaim_cnt);
+  printf ("Frame: %zu shared frames, %lld faults served by sharing\n",
+          hash_size (&share_table), share_hit_cnt);
+  printf ("Frame: %lld copy on write faults, %lld pages copied\n",
+          cow_fault_cnt, cow_copy_cnt);
+  printf ("Frame: %lld mapped pages flushed, "
+          "%lld page cache pages unmapped\n", flush_cnt, cache_unmap_cnt);
+}
+
+/* Returns the frame full of zeroes mapped read-only for the pages
+  that have been read but never written.  It is not in the frame
+  table and is never freed. */
+void *
+frame_zero_page (void)
+{
+  return zero_frame;
 }
 
 /* Get a page for the user address uaddr using the frame allocator.
-  The frame is locked by default. */
+  The frame is pinned by default. */
 void *
-frame_get_page (void *uaddr, enum palloc_flags flags) 
+frame_get_page (void *uaddr, enum palloc_flags flags)
 {
-  void *kaddr; 
+  void *kaddr;
   struct frame_entry *entry;
-  bool locked_outside = true;
 
   /* Must allocate from user pool */
   ASSERT (flags & PAL_USER);
   ASSERT (pg_ofs (uaddr) == 0);
-  
-  if (!lock_held_by_current_thread (&frame_lock))
-    {
-      lock_acquire (&frame_lock);
-      locked_outside = false;
-    }
+  ASSERT (!lock_held_by_current_thread (&frame_lock));
 
   kaddr = palloc_get_page (flags);
-  if (!kaddr) 
-    kaddr = frame_evict_get (flags);
-  // printf ("%d get frame %p\n", thread_current ()->tid, uaddr);
-  
-  ASSERT (kaddr); /* Failed when swap is full */
-  
+  pageout_check ();
+  if (!kaddr)
+    /* The evicted frame keeps its entry and is handed over to us. */
+    return frame_evict_get (uaddr, flags);
+
   entry = malloc (sizeof (struct frame_entry));
   ASSERT (entry);
 
   entry->uaddr = uaddr;
   entry->kaddr = kaddr;
   entry->t = thread_current ();
-  entry->locked = true;
+  entry->pin_cnt = 1;
+  entry->backed = false;
+  entry->mmapped = false;
+  entry->inode = NULL;
+  entry->cow = false;
+  entry->cached = false;
 
+  lock_acquire (&frame_lock);
   hash_insert (&frame_table, &entry->elem);
   list_push_back (&frame_list, &entry->listelem);
+  lock_release (&frame_lock);
 
-  if (!locked_outside)
-    lock_release (&frame_lock);
-
-  // printf ("%s get %p\n", thread_current ()->name, kaddr);
   return kaddr;
 }
 
@@ -115,55 +297,530 @@ frame_free_page (void *kaddr)
   struct frame_entry f;
   struct hash_elem *e;
   struct frame_entry *entry;
-  bool locked_outside = true;
 
   ASSERT (pg_ofs (kaddr) == 0);
 
   f.kaddr = kaddr;
 
-  /* When evicting, the lock is already held by current thread */
-  if (!lock_held_by_current_thread (&frame_lock))
-    {
-      locked_outside = false;
-      lock_acquire (&frame_lock);
-      // printf ("lock_acquire");
-    }
+  lock_acquire (&frame_lock);
   /* Remove the hash_elem with the same kaddr */
   e = hash_delete (&frame_table, &f.elem);
   ASSERT (e);
 
   entry = hash_entry (e, struct frame_entry, elem);
-  list_remove (&entry->listelem);
-  // printf ("remove: %p\n", entry->uaddr);
-
+  ASSERT (!frame_is_shared (entry));
   if (&entry->listelem == clock)
     next_clock ();
+  list_remove (&entry->listelem);
+  if (list_empty (&frame_list))
+    clock = NULL;
+  lock_release (&frame_lock);
 
   palloc_free_page (kaddr);
   free (entry);
+}
 
-  if (!locked_outside)
-    lock_release (&frame_lock);
-  // printf ("freed %p\n", kaddr);
+/* Evict one frame and reuse it for the user address uaddr of the
+  current thread.  The returned frame is pinned. */
+void *
+frame_evict_get (void *uaddr, enum palloc_flags flags)
+{
+  struct frame_entry *f;
+
+  for (;;)
+    {
+      f = frame_evict ();
+      if (f)
+        break;
+      /* Every frame is pinned or its owner is busy, let them go on. */
+      thread_yield ();
+    }
+  direct_reclaim_cnt++;
+
+  lock_acquire (&frame_lock);
+  f->t = thread_current ();
+  f->uaddr = uaddr;
+  f->backed = false;
+  f->mmapped = false;
+  lock_release (&frame_lock);
+
+  if (flags & PAL_ZERO)
+    memset (f->kaddr, 0, PGSIZE);
+  return f->kaddr;
 }
 
-/* Evict one frame to swap and get one free page */
+/* Select a victim and write it back.  Only the victim selection is
+  done under frame_lock, the write back is done holding the owner's
+  supt_lock only, so other processes can keep faulting in the meantime.
+  Returns the evicted frame, pinned and no longer mapped by anybody,
+  or NULL if no frame can be evicted right now. */
+static struct frame_entry *
+frame_evict (void)
+{
+  struct frame_entry *f;
+  struct thread *owner;
+  bool supt_locked;
+
+  lock_acquire (&frame_lock);
+  f = frame_select_eviction (&supt_locked);
+  lock_release (&frame_lock);
+  if (!f)
+    return NULL;
+
+  if (frame_is_shared (f))
+    {
+      struct list locked;
+
+      list_init (&locked);
+      frame_unmap_shared (f, &locked);
+      frame_unlock_mappers (&locked);
+      return f;
+    }
+
+  /* F is pinned and its owner's supt_lock is held, nobody else can
+    touch it until it is written back. */
+  owner = f->t;
+  if (!supt_set_swap (owner, f->uaddr))
+    PANIC ("frame_evict: %p not in the supt of %s", f->uaddr,
+           owner->name);
+  if (supt_locked)
+    lock_release (&owner->supt->supt_lock);
+  return f;
+}
+
+/* Queue the pageout work if free user frames run low. */
+static void
+pageout_check (void)
+{
+  if (!pageout_active && palloc_user_free_cnt () < frame_low_wm)
+    {
+      pageout_active = true;
+      work_queue (&pageout_work);
+    }
+  if (timer_elapsed (flush_last) >= FLUSH_INTERVAL)
+    frame_flush_async ();
+}
+
+/* The pageout work.  Once queued, it evicts frames until there
+  are frame_high_wm free user frames, so most faults can be served
+  from a free frame without waiting for a write back.  Victims are
+  evicted SWAP_CLUSTER at a time, so their swap writes are merged
+  into one I/O. */
+static void
+frame_pageout (void *aux UNUSED)
+{
+  pageout_wakeup_cnt++;
+
+  while (palloc_user_free_cnt () < frame_high_wm)
+    if (frame_evict_batch () == 0)
+      break;
+  pageout_active = false;
+}
+
+/* Select up to SWAP_CLUSTER victims, write them back together and
+  free their frames.  Returns the number of frames freed. */
+static size_t
+frame_evict_batch (void)
+{
+  struct frame_entry *victims[SWAP_CLUSTER];
+  struct frame_entry *shared[SWAP_CLUSTER];
+  struct thread *owners[SWAP_CLUSTER];
+  void *uaddrs[SWAP_CLUSTER];
+  bool supt_locked[SWAP_CLUSTER];
+  struct list locked;
+  size_t want = palloc_user_free_cnt () < frame_high_wm
+                ? frame_high_wm - palloc_user_free_cnt () : 1;
+  size_t cnt, shared_cnt, i;
+
+  if (want > SWAP_CLUSTER)
+    want = SWAP_CLUSTER;
+
+  lock_acquire (&frame_lock);
+  for (cnt = 0, shared_cnt = 0; cnt + shared_cnt < want; )
+    {
+      struct frame_entry *f = frame_select_eviction (&supt_locked[cnt]);
+      if (!f)
+        break;
+      if (frame_is_shared (f))
+        shared[shared_cnt++] = f;
+      else
+        {
+          victims[cnt] = f;
+          owners[cnt] = f->t;
+          uaddrs[cnt] = f->uaddr;
+          cnt++;
+        }
+    }
+  lock_release (&frame_lock);
+
+  /* Every victim is pinned and the supt_lock of every owner is
+    held.  A supt_lock is acquired once, by the first victim that
+    needs it, and others rely on it, so none is released before
+    every victim is unmapped. */
+  if (cnt > 0)
+    supt_set_swap_batch (owners, uaddrs, cnt);
+
+  /* Shared frames are unmapped from every process. */
+  list_init (&locked);
+  for (i = 0; i < shared_cnt; i++)
+    {
+      frame_unmap_shared (shared[i], &locked);
+      frame_free_page (shared[i]->kaddr);
+    }
+
+  frame_unlock_mappers (&locked);
+  for (i = 0; i < cnt; i++)
+    if (supt_locked[i])
+      lock_release (&owners[i]->supt->supt_lock);
+
+  for (i = 0; i < cnt; i++)
+    frame_free_page (victims[i]->kaddr);
+
+  pageout_reclaim_cnt += cnt + shared_cnt;
+  return cnt + shared_cnt;
+}
+
+/* Get the shared frame holding the read-only page at offset OFS of
+  FILE, SIZE bytes of it, and map it at UADDR for the current thread.
+  The page is read from FILE if no process maps it yet.  The frame
+  is pinned, the caller installs it in its page directory. */
+void *
+frame_get_shared (void *uaddr, struct file *file, off_t ofs, off_t size)
+{
+  struct inode *inode = file_get_inode (file);
+  struct frame_mapping *m = malloc (sizeof *m);
+  struct frame_entry *entry;
+  void *kaddr;
+
+  ASSERT (m);
+  m->t = thread_current ();
+  m->uaddr = uaddr;
+  m->locked = false;
+
+  lock_acquire (&frame_lock);
+  entry = share_find (inode, ofs);
+  if (entry)
+    {
+      list_push_back (&entry->mappings, &m->elem);
+      entry->pin_cnt++;
+      share_hit_cnt++;
+      lock_release (&frame_lock);
+      return entry->kaddr;
+    }
+  lock_release (&frame_lock);
+
+  kaddr = frame_get_page (uaddr, PAL_USER | PAL_ZERO);
+  file_read_at (file, kaddr, size, ofs);
+
+  lock_acquire (&frame_lock);
+  /* Somebody else may have read the page in the meantime. */
+  entry = share_find (inode, ofs);
+  if (entry)
+    {
+      list_push_back (&entry->mappings, &m->elem);
+      entry->pin_cnt++;
+      share_hit_cnt++;
+      lock_release (&frame_lock);
+      frame_free_page (kaddr);
+      return entry->kaddr;
+    }
+
+  entry = frame_get_entry (kaddr);
+  entry->inode = inode;
+  entry->ofs = ofs;
+  entry->backed = true;
+  list_init (&entry->mappings);
+  list_push_back (&entry->mappings, &m->elem);
+  hash_insert (&share_table, &entry->share_elem);
+  lock_release (&frame_lock);
+  return kaddr;
+}
+
+/* Thread T does not map the frame at KADDR at UADDR anymore.  A
+  private frame is freed, a shared frame is freed with its last
+  mapping, and a copy on write frame left with a single mapping
+  becomes private to it. */
+void
+frame_release (void *kaddr, struct thread *t, void *uaddr)
+{
+  struct frame_entry *entry;
+  struct list_elem *e;
+  bool last;
+
+  lock_acquire (&frame_lock);
+  entry = frame_get_entry (kaddr);
+  if (!frame_is_shared (entry))
+    {
+      lock_release (&frame_lock);
+      frame_free_page (kaddr);
+      return;
+    }
+
+  for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+       e = list_next (e))
+    {
+      struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+      if (m->t == t && m->uaddr == uaddr)
+        {
+          list_remove (e);
+          free (m);
+          break;
+        }
+    }
+
+  last = list_empty (&entry->mappings);
+  if (last)
+    {
+      /* Anyone pinning it would be mapping it. */
+      ASSERT (entry->pin_cnt == 0);
+      if (entry->inode)
+        hash_delete (&share_table, &entry->share_elem);
+      entry->inode = NULL;
+      entry->cow = false;
+    }
+  else if (entry->cow && list_size (&entry->mappings) == 1)
+    {
+      struct frame_mapping *m = list_entry (list_pop_front (&entry->mappings),
+                                            struct frame_mapping, elem);
+      entry->t = m->t;
+      entry->uaddr = m->uaddr;
+      entry->cow = false;
+      free (m);
+    }
+  lock_release (&frame_lock);
+
+  if (last)
+    frame_free_page (kaddr);
+}
+
+/* Map the frame at KADDR at UADDR of thread T too, after a fork.  A
+  private frame becomes a copy on write frame shared with its owner.
+  The supt_lock of every process mapping the frame must be held. */
+void
+frame_add_mapping (void *kaddr, struct thread *t, void *uaddr)
+{
+  struct frame_entry *entry;
+  struct frame_mapping *m = malloc (sizeof *m);
+
+  ASSERT (m);
+  m->t = t;
+  m->uaddr = uaddr;
+  m->locked = false;
+
+  lock_acquire (&frame_lock);
+  entry = frame_get_entry (kaddr);
+  if (!frame_is_shared (entry))
+    {
+      struct frame_mapping *owner = malloc (sizeof *owner);
+
+      ASSERT (owner);
+      owner->t = entry->t;
+      owner->uaddr = entry->uaddr;
+      owner->locked = false;
+      list_init (&entry->mappings);
+      list_push_back (&entry->mappings, &owner->elem);
+      entry->cow = true;
+    }
+  list_push_back (&entry->mappings, &m->elem);
+  lock_release (&frame_lock);
+}
+
+/* Thread T writes to the copy on write frame at KADDR mapped at
+  UADDR.  Returns true if T is the only process left mapping it, so
+  it can just be made writable; the frame is private to T then.
+  Returns false if T must copy it. */
+bool
+frame_cow_take (void *kaddr, struct thread *t, void *uaddr)
+{
+  struct frame_entry *entry;
+  bool mine;
+
+  lock_acquire (&frame_lock);
+  entry = frame_get_entry (kaddr);
+  cow_fault_cnt++;
+  mine = !entry->cow;
+  if (entry->cow && list_size (&entry->mappings) == 1)
+    {
+      struct frame_mapping *m = list_entry (list_pop_front (&entry->mappings),
+                                            struct frame_mapping, elem);
+      free (m);
+      entry->cow = false;
+      mine = true;
+    }
+  if (mine)
+    {
+      entry->t = t;
+      entry->uaddr = uaddr;
+    }
+  else
+    cow_copy_cnt++;
+  lock_release (&frame_lock);
+  return mine;
+}
+
+/* Map page IDX of INODE, from the page cache, at UADDR of the
+  current thread.  If the page cache has no page left to map, the
+  coldest mapped page is unmapped from every process mapping it.
+  Returns the page, pinned, or NULL if no page can be unmapped right
+  now: the caller lets the other processes go on and tries again.
+  The supt_lock of the current thread must be held. */
 void *
-frame_evict_get (enum palloc_flags flags)
+frame_get_cached (void *uaddr, struct inode *inode, size_t idx)
+{
+  struct frame_mapping *m;
+  struct frame_entry *entry;
+  struct hash_elem *e;
+  void *kaddr;
+
+  while ((kaddr = pagecache_map (inode, idx)) == NULL)
+    if (!frame_evict_cached ())
+      return NULL;
+
+  m = malloc (sizeof *m);
+  ASSERT (m);
+  m->t = thread_current ();
+  m->uaddr = uaddr;
+  m->locked = false;
+
+  lock_acquire (&frame_lock);
+  entry = malloc (sizeof *entry);
+  ASSERT (entry);
+  entry->kaddr = kaddr;
+  e = hash_insert (&frame_table, &entry->elem);
+  if (e != NULL)
+    {
+      /* Other processes map it already. */
+      free (entry);
+      entry = hash_entry (e, struct frame_entry, elem);
+    }
+  else
+    {
+      entry->uaddr = NULL;
+      entry->t = NULL;
+      entry->pin_cnt = 0;
+      entry->inode = inode;
+      entry->ofs = idx * PGSIZE;
+      entry->cow = false;
+      entry->backed = true;
+      entry->mmapped = false;
+      entry->cached = true;
+      list_init (&entry->mappings);
+      list_push_back (&cache_list, &entry->listelem);
+    }
+  ASSERT (entry->cached);
+  list_push_back (&entry->mappings, &m->elem);
+  entry->pin_cnt++;
+  lock_release (&frame_lock);
+
+  return kaddr;
+}
+
+/* Thread T does not map the page cache page at KADDR at UADDR
+  anymore.  The caller hands the page back to the page cache. */
+void
+frame_release_cached (void *kaddr, struct thread *t, void *uaddr)
+{
+  struct frame_entry *entry;
+  struct list_elem *e;
+
+  lock_acquire (&frame_lock);
+  entry = frame_get_entry (kaddr);
+  ASSERT (entry->cached);
+  for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+       e = list_next (e))
+    {
+      struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+      if (m->t == t && m->uaddr == uaddr)
+        {
+          list_remove (e);
+          free (m);
+          break;
+        }
+    }
+  if (list_empty (&entry->mappings))
+    {
+      /* Anyone pinning it would be mapping it. */
+      ASSERT (entry->pin_cnt == 0);
+      hash_delete (&frame_table, &entry->elem);
+      list_remove (&entry->listelem);
+      free (entry);
+    }
+  lock_release (&frame_lock);
+}
+
+/* Unmap the coldest page cache page that is mapped, not pinned, and
+  whose mappers' supt_locks can be taken, from every process, so the
+  page cache can map another page.  Returns false if there is none. */
+static bool
+frame_evict_cached (void)
 {
-  struct frame_entry *f = frame_select_eviction ();
-  // printf ("evicted: %p\n", f->kaddr);
-  ASSERT (f);
+  struct frame_entry *victim = NULL;
+  struct list locked;
+  size_t cnt;
+
+  /* Second chance, as for the frames: twice around the clock clears
+    every accessed bit on the way. */
+  lock_acquire (&frame_lock);
+  for (cnt = 2 * list_size (&cache_list); cnt > 0; cnt--)
+    {
+      struct frame_entry *entry = list_entry (list_pop_front (&cache_list),
+                                              struct frame_entry, listelem);
+      list_push_back (&cache_list, &entry->listelem);
+      if (entry->pin_cnt > 0)
+        continue;
+      if (frame_is_accessed (entry))
+        {
+          frame_clear_accessed (entry);
+          continue;
+        }
+      if (frame_lock_mappers (entry))
+        {
+          /* Nobody may map it from now on, a new mapping gets an
+            entry of its own. */
+          hash_delete (&frame_table, &entry->elem);
+          list_remove (&entry->listelem);
+          victim = entry;
+          break;
+        }
+    }
+  lock_release (&frame_lock);
+  if (victim == NULL)
+    return false;
 
-  ASSERT (supt_set_swap (f->t, f->uaddr))
+  /* No mapping can go away, since every supt_lock is held. */
+  list_init (&locked);
+  while (!list_empty (&victim->mappings))
+    {
+      struct frame_mapping *m = list_entry (list_pop_front (&victim->mappings),
+                                            struct frame_mapping, elem);
+      supt_evict_cached (m->t, m->uaddr);
+      if (m->locked)
+        list_push_back (&locked, &m->elem);
+      else
+        free (m);
+    }
+  frame_unlock_mappers (&locked);
+  free (victim);
+  cache_unmap_cnt++;
+  return true;
+}
 
-  // if (!supt_set_swap (f->t, f->uaddr))
-  //   return NULL;      /* Failed to set swap */
+/* Find the shared frame of page OFS of INODE.  frame_lock must be
+  held. */
+static struct frame_entry *
+share_find (struct inode *inode, off_t ofs)
+{
+  struct frame_entry tmp;
+  struct hash_elem *e;
 
-  return palloc_get_page (flags);
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  tmp.inode = inode;
+  tmp.ofs = ofs;
+  e = hash_find (&share_table, &tmp.share_elem);
+  return e ? hash_entry (e, struct frame_entry, share_elem) : NULL;
 }
 
-/* Get the frame entry at kaddr */
+/* Get the frame entry at kaddr.  frame_lock must be held. */
 struct frame_entry *
 frame_get_entry (void *kaddr)
 {
@@ -171,6 +828,7 @@ frame_get_entry (void *kaddr)
   struct hash_elem *e;
 
   ASSERT (pg_ofs (kaddr) == 0);
+  ASSERT (lock_held_by_current_thread (&frame_lock));
   tmp.kaddr = kaddr;
 
   e = hash_find (&frame_table, &tmp.elem);
@@ -181,52 +839,454 @@ frame_get_entry (void *kaddr)
   return hash_entry (e, struct frame_entry, elem);
 }
 
-/* Set the frame at kaddr to locked. LOCK before calling */
+/* Pin the frame at kaddr so it will not be evicted. */
+void
+frame_pin (void *kaddr)
+{
+  lock_acquire (&frame_lock);
+  frame_get_entry (kaddr)->pin_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Unpin the frame at kaddr, it can be evicted afterwards. */
 void
-frame_set_locked (void *kaddr)
+frame_unpin (void *kaddr)
 {
-  frame_get_entry (kaddr)->locked = true;
+  struct frame_entry *entry;
+
+  lock_acquire (&frame_lock);
+  entry = frame_get_entry (kaddr);
+  ASSERT (entry->pin_cnt > 0);
+  entry->pin_cnt--;
+  lock_release (&frame_lock);
 }
 
-/* Set the frame at kaddr to unlocked. LOCK before calling  */
+/* Tell the frame at kaddr whether its content is also kept in its
+  swap slot or file, see frame_entry.backed. */
 void
-frame_set_unlocked (void *kaddr)
+frame_set_backed (void *kaddr, bool backed)
 {
-  frame_get_entry (kaddr)->locked = false;
+  lock_acquire (&frame_lock);
+  frame_get_entry (kaddr)->backed = backed;
+  lock_release (&frame_lock);
 }
 
-/* Select a frame to evict */
+/* Tell the frame at kaddr that it holds a page of a memory mapped
+  file, see frame_entry.mmapped. */
+void
+frame_set_mmapped (void *kaddr)
+{
+  lock_acquire (&frame_lock);
+  frame_get_entry (kaddr)->mmapped = true;
+  lock_release (&frame_lock);
+}
+
+/* Queue the flush work to write back the dirty pages of memory
+  mapped files, without waiting for it. */
+void
+frame_flush_async (void)
+{
+  work_queue (&flush_work);
+}
+
+/* Select a frame to evict.  The selected frame is pinned and the
+  supt_lock of its owner is held on return, *SUPT_LOCKED tells if it
+  is acquired here.  Returns NULL if no frame can be evicted now.
+  frame_lock must be held. */
 static struct frame_entry *
-frame_select_eviction ()
+frame_select_eviction (bool *supt_locked)
 {
-  int count = hash_size (&frame_table) * 2;
+  size_t frame_cnt = hash_size (&frame_table);
+  bool skipped_dirty = false;
+  struct pagedir_batch batch;
   struct frame_entry *entry;
-  while (count--)
+  int pass;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* The clock hand may clear many accessed bits in a row. */
+  pagedir_batch_begin (&batch);
+
+  /* Enhanced second chance: classify the frames by (accessed, needs
+    write).  Even passes look for (0, 0) without touching anything, 
+    odd passes take any not accessed frame and clear the accessed bits
+    on the way, so a clean page is always preferred to a dirty one. */
+  for (pass = 0; pass < 4; pass++)
     {
-      next_clock ();
-      entry = list_entry (clock, struct frame_entry, listelem);
-      if (entry->locked)
-        continue;
-      else if (pagedir_is_accessed (entry->t->pagedir, entry->uaddr)) 
+      size_t count;
+
+      for (count = 0; count < frame_cnt; count++)
         {
-          pagedir_set_accessed (entry->t->pagedir, entry->uaddr, false);
-          continue;
+          bool accessed;
+
+          next_clock ();
+          entry = list_entry (clock, struct frame_entry, listelem);
+          if (entry->pin_cnt > 0)
+            continue;
+
+          accessed = frame_is_accessed (entry);
+          if (pass % 2 == 0)
+            {
+              if (accessed)
+                continue;
+              if (frame_needs_write (entry))
+                {
+                  skipped_dirty = true;
+                  continue;
+                }
+            }
+          else if (accessed)
+            {
+              frame_clear_accessed (entry);
+              continue;
+            }
+
+          if (frame_is_shared (entry))
+            {
+              *supt_locked = false;
+              if (!frame_lock_mappers (entry))
+                continue;
+              /* Nobody may map it from now on. */
+              if (entry->inode)
+                hash_delete (&share_table, &entry->share_elem);
+            }
+          else if (!frame_lock_owner (entry, supt_locked))
+            continue;
+
+          /* Let the cleaner prepare clean victims for next time. */
+          if (skipped_dirty && frame_async_clean)
+            work_queue (&clean_work);
+
+          evict_cnt++;
+          if (frame_needs_write (entry))
+            evict_dirty_cnt++;
+          entry->pin_cnt++;
+          pagedir_batch_end (&batch);
+          return entry;
         }
-      return entry;
     }
-  
-  NOT_REACHED ();
-  /* Not reached */
+
+  pagedir_batch_end (&batch);
   return NULL;
 }
 
-static void 
+/* Returns true if any process mapping ENTRY accessed it. */
+static bool
+frame_is_accessed (struct frame_entry *entry)
+{
+  struct list_elem *e;
+
+  if (!frame_is_shared (entry))
+    return pagedir_is_accessed (entry->t->pagedir, entry->uaddr);
+
+  for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+       e = list_next (e))
+    {
+      struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+      if (pagedir_is_accessed (m->t->pagedir, m->uaddr))
+        return true;
+    }
+  return false;
+}
+
+/* Clear the accessed bit of ENTRY in every page table mapping it. */
+static void
+frame_clear_accessed (struct frame_entry *entry)
+{
+  struct list_elem *e;
+
+  if (!frame_is_shared (entry))
+    {
+      pagedir_set_accessed (entry->t->pagedir, entry->uaddr, false);
+      return;
+    }
+
+  for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+       e = list_next (e))
+    {
+      struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+      pagedir_set_accessed (m->t->pagedir, m->uaddr, false);
+    }
+}
+
+/* Try to get the supt_lock of every process mapping the shared frame
+  ENTRY without blocking, like frame_lock_owner.  On failure, the
+  locks acquired so far are released. */
+static bool
+frame_lock_mappers (struct frame_entry *entry)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+       e = list_next (e))
+    {
+      struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+      if (!frame_lock_owner_of (m->t, &m->locked))
+        break;
+    }
+  if (e == list_end (&entry->mappings))
+    return true;
+
+  while (e != list_begin (&entry->mappings))
+    {
+      struct frame_mapping *m;
+
+      e = list_prev (e);
+      m = list_entry (e, struct frame_mapping, elem);
+      if (m->locked)
+        lock_release (&m->t->supt->supt_lock);
+    }
+  return false;
+}
+
+/* Unmap the shared frame ENTRY selected for eviction from every
+  process.  The mappings whose supt_lock was taken by
+  frame_lock_mappers are moved to LOCKED, release them with
+  frame_unlock_mappers.  Nobody can map it anymore, since it is not in share_table, and no
+  mapping can go away, since every supt_lock is held.  A copy on write
+  frame is written once to a swap slot shared by all of them, unless
+  each of them has a good copy already. */
+static void
+frame_unmap_shared (struct frame_entry *entry, struct list *locked)
+{
+  block_sector_t sector = SWAP_SECTOR_INIT;
+  struct list_elem *e;
+
+  if (entry->cow)
+    {
+      bool write = frame_needs_write (entry);
+
+      for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+           e = list_next (e))
+        {
+          struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+          if (supt_cow_needs_write (m->t, m->uaddr))
+            write = true;
+        }
+      if (write)
+        {
+          sector = swap_get_slot ();
+          swap_write (sector, entry->kaddr);
+        }
+    }
+
+  while (!list_empty (&entry->mappings))
+    {
+      struct frame_mapping *m;
+
+      e = list_pop_front (&entry->mappings);
+      m = list_entry (e, struct frame_mapping, elem);
+      if (entry->cow)
+        supt_cow_evicted (m->t, m->uaddr, sector);
+      else
+        supt_unmap_shared (m->t, m->uaddr);
+      if (m->locked)
+        list_push_back (locked, &m->elem);
+      else
+        free (m);
+    }
+
+  /* Every mapping holds its own reference to the slot now. */
+  if (sector != SWAP_SECTOR_INIT)
+    free_swap_slot (sector);
+
+  lock_acquire (&frame_lock);
+  entry->inode = NULL;
+  entry->cow = false;
+  lock_release (&frame_lock);
+}
+
+/* Release the supt_locks of the mappings in LOCKED, left by
+  frame_unmap_shared, and free them. */
+static void
+frame_unlock_mappers (struct list *locked)
+{
+  while (!list_empty (locked))
+    {
+      struct frame_mapping *m = list_entry (list_pop_front (locked),
+                                            struct frame_mapping, elem);
+      lock_release (&m->t->supt->supt_lock);
+      free (m);
+    }
+}
+
+/* Returns true if ENTRY is mapped by several processes, see
+  frame_entry.inode and frame_entry.cow. */
+static bool
+frame_is_shared (struct frame_entry *entry)
+{
+  return entry->inode != NULL || entry->cow;
+}
+
+/* Try to get the supt_lock of the owner of ENTRY without blocking.
+  Since the frame is in the table, the owner has not destroyed its
+  supt yet, and it cannot do so while frame_lock is held by us. */
+static bool
+frame_lock_owner (struct frame_entry *entry, bool *supt_locked)
+{
+  return frame_lock_owner_of (entry->t, supt_locked);
+}
+
+/* Try to get the supt_lock of thread T without blocking.  Returns
+  true if it is held by the current thread afterwards, *SUPT_LOCKED
+  tells if it is acquired here. */
+static bool
+frame_lock_owner_of (struct thread *t, bool *supt_locked)
+{
+  struct lock *supt_lock = &t->supt->supt_lock;
+
+  *supt_locked = false;
+  if (lock_held_by_current_thread (supt_lock))
+    return true;
+  if (!lock_try_acquire (supt_lock))
+    return false;
+  *supt_locked = true;
+  return true;
+}
+
+/* Returns true if evicting ENTRY requires writing it back. */
+static bool
+frame_needs_write (struct frame_entry *entry)
+{
+  uint32_t *pd;
+
+  if (entry->inode)
+    return false;
+  if (entry->cow)
+    {
+      struct list_elem *e;
+
+      if (!entry->backed)
+        return true;
+      for (e = list_begin (&entry->mappings); e != list_end (&entry->mappings);
+           e = list_next (e))
+        {
+          struct frame_mapping *m = list_entry (e, struct frame_mapping, elem);
+          if (pagedir_is_dirty (m->t->pagedir, m->uaddr)
+              || pagedir_is_dirty (m->t->pagedir, entry->kaddr))
+            return true;
+        }
+      return false;
+    }
+  pd = entry->t->pagedir;
+  return !entry->backed || pagedir_is_dirty (pd, entry->uaddr)
+         || pagedir_is_dirty (pd, entry->kaddr);
+}
+
+/* The cleaner work, writes back dirty frames ahead of the clock
+  hand whenever the eviction had to skip dirty frames. */
+static void
+frame_cleaner (void *aux UNUSED)
+{
+  frame_clean_ahead ();
+}
+
+/* Write back up to CLEAN_BATCH not accessed, dirty frames among the
+  CLEAN_SCAN frames ahead of the clock hand.  The frames stay in 
+  memory and become clean victims. */
+static void
+frame_clean_ahead (void)
+{
+  struct list_elem *e;
+  int scanned, cleaned = 0;
+
+  lock_acquire (&frame_lock);
+  e = clock;
+  for (scanned = 0; scanned < CLEAN_SCAN && cleaned < CLEAN_BATCH
+                    && !list_empty (&frame_list); scanned++)
+    {
+      struct frame_entry *entry;
+      struct thread *owner;
+      bool supt_locked;
+
+      if (e == NULL || list_next (e) == list_end (&frame_list))
+        e = list_begin (&frame_list);
+      else
+        e = list_next (e);
+
+      entry = list_entry (e, struct frame_entry, listelem);
+      if (entry->pin_cnt > 0 || frame_is_shared (entry)
+          || pagedir_is_accessed (entry->t->pagedir, entry->uaddr)
+          || !frame_needs_write (entry)
+          || !frame_lock_owner (entry, &supt_locked))
+        continue;
+
+      entry->pin_cnt++;
+      owner = entry->t;
+      lock_release (&frame_lock);
+
+      supt_clean_page (owner, entry->uaddr);
+
+      /* Unpin before giving up the supt_lock, the owner may free the
+        frame as soon as it gets the lock back. */
+      lock_acquire (&frame_lock);
+      entry->backed = true;
+      entry->pin_cnt--;
+      if (supt_locked)
+        lock_release (&owner->supt->supt_lock);
+      clean_cnt++;
+      cleaned++;
+    }
+  lock_release (&frame_lock);
+}
+
+/* The flush work, see frame_flush_async.  The page cache is written
+  back too, it holds the pages of memory mapped files marked dirty
+  by msync (MS_ASYNC) or munmap. */
+static void
+frame_flusher (void *aux UNUSED)
+{
+  flush_last = timer_ticks ();
+  frame_flush ();
+  pagecache_flush ();
+}
+
+/* Write back every dirty frame holding a page of a memory mapped
+  file, so msync, munmap and eviction find them clean.  Frames whose
+  owner is busy are left for the next time. */
+static void
+frame_flush (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame_entry *entry = list_entry (e, struct frame_entry, 
+                                              listelem);
+      struct thread *owner;
+      bool supt_locked;
+
+      if (!entry->mmapped || entry->pin_cnt > 0 || frame_is_shared (entry)
+          || !frame_needs_write (entry)
+          || !frame_lock_owner (entry, &supt_locked))
+        continue;
+
+      entry->pin_cnt++;
+      owner = entry->t;
+      lock_release (&frame_lock);
+
+      supt_clean_page (owner, entry->uaddr);
+
+      /* The entry stays in the list while it is pinned and its
+        owner is locked, so the walk can go on from it. */
+      lock_acquire (&frame_lock);
+      entry->pin_cnt--;
+      if (supt_locked)
+        lock_release (&owner->supt->supt_lock);
+      flush_cnt++;
+    }
+  lock_release (&frame_lock);
+}
+
+static void
 next_clock ()
 {
   if (!clock)
     clock = list_begin (&frame_list);
-  else 
+  else
     clock = list_next (clock);
   if (clock == list_end (&frame_list))
     clock = list_begin (&frame_list);
-}
\ No newline at end of file
+}
@@ -3,14 +3,38 @@
 
 #include "lib/kernel/hash.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+#include "filesys/file.h"
+
+/* Clean dirty frames in the background.  Controlled by kernel
+   command-line option "-async-clean". */
+extern bool frame_async_clean;
+
+/* Free user frame watermarks for the pageout work.  Controlled by
+   kernel command-line options "-pageout-low" and "-pageout-high". */
+extern size_t frame_low_wm;
+extern size_t frame_high_wm;
 
 void frame_init (void);
+void frame_print_stats (void);
 void *frame_get_page (void *uaddr, enum palloc_flags flags);
 void frame_free_page (void *kaddr);
-void *frame_evict_get (enum palloc_flags flags);
+void *frame_evict_get (void *uaddr, enum palloc_flags flags);
 
-void frame_set_locked (void *kaddr);
-void frame_set_unlocked (void *kaddr);
+void frame_pin (void *kaddr);
+void frame_unpin (void *kaddr);
+void frame_set_backed (void *kaddr, bool backed);
+void frame_set_mmapped (void *kaddr);
+void frame_flush_async (void);
+void *frame_zero_page (void);
+
+void *frame_get_shared (void *uaddr, struct file *file, off_t ofs, off_t size);
+void frame_release (void *kaddr, struct thread *t, void *uaddr);
+void frame_add_mapping (void *kaddr, struct thread *t, void *uaddr);
+bool frame_cow_take (void *kaddr, struct thread *t, void *uaddr);
 struct frame_entry *frame_get_entry (void *kaddr);
 
-#endif
\ No newline at end of file
+void *frame_get_cached (void *uaddr, struct inode *inode, size_t idx);
+void frame_release_cached (void *kaddr, struct thread *t, void *uaddr);
+
+#endif
@@ -1,5 +1,4 @@
 #include "page.h"
-#include "lib/kernel/hash.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
@@ -9,37 +8,30 @@
 #include "userprog/pagedir.h"
 #include "userprog/exception.h"
 #include "filesys/file.h"
+#include "filesys/pagecache.h"
 #include <stdio.h>
-
-extern struct lock frame_lock;
+#include <string.h>
 
 static void load_file_to_page (struct supt_table *table, void *uaddr);
-static void supt_update_dirty (struct supt_entry *entry, uint32_t *pd);
-
-/* hash functions */
-static unsigned 
-entry_hash (const struct hash_elem *e, void *aux UNUSED)
-{
-  struct supt_entry *entry = hash_entry (e, struct supt_entry, elem);
-  return (unsigned) entry->uaddr;
-}
-
-static bool 
-entry_less (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
-{
-  struct supt_entry *e1 = hash_entry (a, struct supt_entry, elem);
-  struct supt_entry *e2 = hash_entry (b, struct supt_entry, elem);
-  return e1->uaddr < e2->uaddr;
-}
-
-static void 
-entry_destory (struct hash_elem *e, void *aux UNUSED)
-{
-  struct supt_entry *entry = hash_entry (e, struct supt_entry, elem);
-  if (entry->filefrom)
-    free (entry->filefrom);
-  free (entry);
-}
+static void supt_update_dirty (struct supt_entry *entry, uint32_t *pd,
+                               void *uaddr);
+static void supt_detach_private (struct supt_entry *entry);
+static bool supt_is_shared (struct supt_entry *entry);
+static void supt_swap_in (struct supt_table *table, struct supt_entry *entry,
+                          void *uaddr, void *kaddr);
+static void *supt_map_entry (struct supt_table *table, 
+                             struct supt_entry *entry, void *uaddr);
+static void *supt_map_cached (struct supt_table *table,
+                              struct supt_entry *entry, void *uaddr);
+static void supt_unmap_cached (struct supt_entry *entry, uint32_t *pd,
+                               void *uaddr);
+static struct supt_entry *supt_slot (struct supt_table *table, void *uaddr,
+                                     bool create);
+static struct supt_entry *supt_chunk (struct supt_table *table, size_t c);
+static void *supt_uaddr (size_t c, size_t idx);
+
+/* Most pages mapped by a single fault, see supt_fault_around. */
+#define FAULT_AROUND_MAX 16
 
 /* Create a supplemental page table for the process. */
 struct supt_table *
@@ -47,8 +39,14 @@ supt_create ()
 {
   struct supt_table *table = malloc (sizeof (struct supt_table));
 
-  hash_init (&table->supt_hash, entry_hash, entry_less, NULL);
+  ASSERT (sizeof (struct supt_entry) * SUPT_CHUNK_CNT <= PGSIZE);
+  if (table == NULL)
+    return NULL;
+
+  memset (table->dir, 0, sizeof table->dir);
   lock_init (&table->supt_lock);
+  table->last_fault = NULL;
+  table->window = 1;
 
   return table;
 }
@@ -57,35 +55,55 @@ supt_create ()
 void 
 supt_destroy (struct supt_table *table, uint32_t *pd)
 {
-  struct hash_iterator i;
+  struct pagedir_batch batch;
+  size_t c, j;
 
   ASSERT (table);
 
-  /* Free all the swap slot occupied by the supt */
-  lock_acquire (&frame_lock);
+  /* Free all the swap slot occupied by the supt.  Evictors only
+    try_acquire the supt_lock, so they skip our frames from now on. */
   lock_acquire (&table->supt_lock);
+  pagedir_batch_begin (&batch);
 
-  hash_first (&i, &table->supt_hash);
-  while (hash_next (&i))
+  for (c = 0; c < SUPT_DIR_CNT * SUPT_GROUP_CNT; c++)
     {
-      struct supt_entry *entry = hash_entry (hash_cur (&i), 
-                                            struct supt_entry, elem);
-      if (entry->state == PG_IN_SWAP)
-        free_swap_slot (entry->swap_sector);
-      else if (entry->state == PG_IN_MEM)
+      struct supt_entry *chunk = supt_chunk (table, c);
+
+      if (chunk == NULL)
+        continue;
+      for (j = 0; j < SUPT_CHUNK_CNT; j++)
         {
-          if (entry->swap_sector != SWAP_SECTOR_INIT) 
-            free_swap_slot (entry->swap_sector);
+          struct supt_entry *entry = &chunk[j];
+          void *uaddr = supt_uaddr (c, j);
 
-          pagedir_clear_page(pd, entry->uaddr);
-          frame_free_page (entry->kaddr);
+          if (entry->state == PG_IN_SWAP)
+            free_swap_slot (entry->swap_sector);
+          else if (entry->state == PG_ZERO)
+            /* The zero frame must not be freed by pagedir_destroy. */
+            pagedir_clear_page (pd, uaddr);
+          else if (entry->state == PG_IN_MEM)
+            {
+              if (entry->swap_sector != SWAP_SECTOR_INIT) 
+                free_swap_slot (entry->swap_sector);
+
+              pagedir_clear_page(pd, uaddr);
+              frame_release (entry->kaddr, thread_current (), uaddr);
+            }
+          else if (entry->state == PG_IN_CACHE)
+            {
+              frame_release_cached (entry->kaddr, thread_current (), uaddr);
+              supt_unmap_cached (entry, pd, uaddr);
+            }
+          if (entry->filefrom)
+            free (entry->filefrom);
         }
+      palloc_free_page (chunk);
     }
+  for (c = 0; c < SUPT_DIR_CNT; c++)
+    free (table->dir[c]);
 
-  hash_destroy (&table->supt_hash, entry_destory);
-
+  pagedir_batch_end (&batch);
   lock_release (&table->supt_lock);
-  lock_release (&frame_lock);
 
   free (table);
 }
@@ -99,19 +117,26 @@ bool
 supt_install_page (struct supt_table *table, void *uaddr, void *kaddr, 
                       enum page_state state)
 {
-  struct supt_entry *entry = malloc (sizeof (struct supt_entry));;
-  struct hash_elem *e;
+  struct supt_entry *entry;
 
   ASSERT (table);
-  ASSERT (entry);
 
   ASSERT (uaddr == pg_round_down (uaddr));
   lock_acquire (&table->supt_lock);
 
-  entry->uaddr = uaddr;
+  /* Check if the page is present */
+  entry = supt_slot (table, uaddr, true);
+  if (entry == NULL || entry->state != PG_NONE)
+    {
+      lock_release (&table->supt_lock);
+      return false;
+    }
+
   entry->swap_sector = SWAP_SECTOR_INIT;
   entry->state = state;
   entry->dirty = false;
+  entry->writable = true;
+  entry->cow = false;
   entry->filefrom = NULL;
 
   if (state == PG_IN_MEM)
@@ -119,16 +144,6 @@ supt_install_page (struct supt_table *table, void *uaddr, void *kaddr,
   else 
     entry->kaddr = NULL;
 
-  /* Check if the page is present */
-  e = hash_find (&table->supt_hash, &entry->elem);
-
-  if (e)
-    {
-      free (entry);
-      return false;
-    }
-
-  hash_insert (&table->supt_hash, &entry->elem);
   lock_release (&table->supt_lock);
 
   // printf ("%d installed: %p.\n", thread_current()->tid, uaddr);  
@@ -156,51 +171,80 @@ supt_install_filemap (struct supt_table *table, void *uaddr, struct file *fl,
   entry->filefrom->fl = fl;
   entry->filefrom->offset = offset;
   entry->filefrom->size_in_page = size;
+  entry->filefrom->private = false;
 
   lock_release (&table->supt_lock);
   return true;
 }
 
+/* Install a page of an executable segment in supt, loaded on demand
+  from fl like a file map, but private: changes to a writable page
+  go to swap, never to the file. */
+bool
+supt_install_execmap (struct supt_table *table, void *uaddr, struct file *fl,
+                      off_t offset, off_t size, bool writable)
+{
+  struct supt_entry *entry;
+
+  if (!supt_install_filemap (table, uaddr, fl, offset, size))
+    return false;
+
+  lock_acquire (&table->supt_lock);
+  entry = supt_look_up (table, uaddr);
+  entry->filefrom->private = true;
+  entry->writable = writable;
+  lock_release (&table->supt_lock);
+  return true;
+}
+
+/* Remove the file map of SIZE bytes at UADDR of the current thread,
+  dirty pages are written back to the file. */
 void 
 supt_remove_filemap (struct supt_table *table, void *uaddr, off_t size)
 {
   uintptr_t base = (uintptr_t) uaddr;
   /* Delete it from the page table */
   uintptr_t top = (uintptr_t)(uaddr + size);
-  lock_acquire (&frame_lock);
   lock_acquire (&table->supt_lock);
   while (base <= top)
     {
-      struct supt_entry tmp;
-      struct hash_elem *e;
-      /* write the memory map region to file system */
-      supt_set_swap (thread_current (), (void *)base);
+      struct supt_entry *entry;
+
+      entry = supt_look_up (table, (void *)base);
+      ASSERT (entry);
 
-      tmp.uaddr = (void *)base;
-      /* delete the entry from the supt */
-      e = hash_delete (&table->supt_hash, &tmp.elem);
+      /* write the memory map region to file system */
+      if (entry->state == PG_IN_MEM)
+        {
+          void *kaddr = entry->kaddr;
+          supt_set_swap (thread_current (), (void *)base);
+          frame_free_page (kaddr);
+        }
+      else if (entry->state == PG_IN_CACHE)
+        {
+          frame_release_cached (entry->kaddr, thread_current (),
+                                (void *)base);
+          supt_unmap_cached (entry, thread_current ()->pagedir,
+                             (void *)base);
+        }
 
-      /* deallocate resources */
-      entry_destory (e, NULL);
+      /* delete the entry from the supt and deallocate resources */
+      free (entry->filefrom);
+      memset (entry, 0, sizeof *entry);
       base += PGSIZE;
     }
 
   lock_release (&table->supt_lock);
-  lock_release (&frame_lock);
 }
 
 /* Find if the page contains address uaddr is in the supt */
 bool 
 supt_contains (struct supt_table *table, void *uaddr)
 {
-  struct supt_entry entry;
   bool find;
 
-  ASSERT (is_user_vaddr (uaddr));
-  entry.uaddr = pg_round_down (uaddr);
-
   lock_acquire (&table->supt_lock);
-  find = !!hash_find (&table->supt_hash, &entry.elem);
+  find = supt_look_up (table, uaddr) != NULL;
   lock_release (&table->supt_lock);
   return find;
 }
@@ -210,52 +254,123 @@ supt_contains (struct supt_table *table, void *uaddr)
 struct supt_entry *
 supt_look_up (struct supt_table *table, void *uaddr)
 {
-  struct supt_entry tmp;
-  struct hash_elem *e;
+  struct supt_entry *entry;
 
   ASSERT (is_user_vaddr (uaddr));
-  tmp.uaddr = pg_round_down (uaddr);
-
-  e = hash_find (&table->supt_hash, &tmp.elem);
-  if (e)
-    return hash_entry (e, struct supt_entry, elem);
+  entry = supt_slot (table, pg_round_down (uaddr), false);
+  if (entry && entry->state != PG_NONE)
+    return entry;
 
   return NULL;
 }
 
+/* Returns the slot of the entry of the page at uaddr in table, empty
+  or not.  Its chunk is allocated if create, otherwise NULL is
+  returned if there is no chunk for uaddr. */
+static struct supt_entry *
+supt_slot (struct supt_table *table, void *uaddr, bool create)
+{
+  uintptr_t pg = pg_no (uaddr);
+  struct supt_entry ***group = &table->dir[pd_no (uaddr)];
+  struct supt_entry **chunk;
+
+  if (*group == NULL)
+    {
+      if (!create)
+        return NULL;
+      *group = calloc (SUPT_GROUP_CNT, sizeof **group);
+      if (*group == NULL)
+        return NULL;
+    }
+  chunk = &(*group)[(pg >> SUPT_CHUNK_BITS) & (SUPT_GROUP_CNT - 1)];
+  if (*chunk == NULL)
+    {
+      if (!create)
+        return NULL;
+      *chunk = palloc_get_page (PAL_ZERO);
+      if (*chunk == NULL)
+        return NULL;
+    }
+  return *chunk + (pg & (SUPT_CHUNK_CNT - 1));
+}
+
+/* Returns the c-th chunk of table, counting from address 0, or NULL
+  if it is not allocated. */
+static struct supt_entry *
+supt_chunk (struct supt_table *table, size_t c)
+{
+  struct supt_entry **group = table->dir[c >> SUPT_GROUP_BITS];
+
+  return group != NULL ? group[c & (SUPT_GROUP_CNT - 1)] : NULL;
+}
+
+/* Returns the user address of the idx-th entry of the c-th chunk. */
+static void *
+supt_uaddr (size_t c, size_t idx)
+{
+  return (void *) (((c << SUPT_CHUNK_BITS) | idx) << PGBITS);
+}
 
+
+/* Load the page at uaddr into a frame and map it.  The frame is 
+  pinned on success, unpin it with supt_unlock_mem.
+  Only the supt_lock of the table is held during the disk I/O, so
+  the faults of other processes are not blocked by it. */
 bool 
 supt_load_page (struct supt_table *table, void *uaddr)
 {
   struct supt_entry *entry;
-  struct thread *t = thread_current ();
-  void *kaddr;
+  bool success = false;
 
-  /* frame table should be locked */
-  lock_acquire (&frame_lock);
   lock_acquire (&table->supt_lock);
   
   entry = supt_look_up (table, uaddr);
-  // ASSERT (entry);
-  if (!entry)
-    goto supt_load_page_err;
+  if (entry && (entry->state == PG_IN_MEM || entry->state == PG_IN_CACHE))
+    {
+      /* Nobody can be evicting it since we hold the supt_lock. */
+      frame_pin (entry->kaddr);
+      success = true;
+    }
+  else if (entry)
+    success = supt_map_entry (table, entry, pg_round_down (uaddr)) != NULL;
+
+  lock_release (&table->supt_lock);
+  return success;
+}
+
+/* Bring the page of entry, which is not in memory, into a frame and
+  map it.  Returns the frame, pinned, or NULL on failure.  The
+  supt_lock of table must be held. */
+static void *
+supt_map_entry (struct supt_table *table, struct supt_entry *entry,
+                void *uaddr)
+{
+  struct thread *t = thread_current ();
+  void *kaddr;
+
+  ASSERT (lock_held_by_current_thread (&table->supt_lock));
 
-  // printf ("%d load %p \n", thread_current ()->tid, uaddr);
   switch (entry->state)
     {
-    case PG_IN_MEM:
-      frame_set_locked (entry->kaddr);
-      lock_release (&table->supt_lock);
-      lock_release (&frame_lock);
-      return true;
     case PG_ZERO:
       kaddr = frame_get_page (uaddr, PAL_USER | PAL_ZERO);
+      /* It may be mapped to the zero frame. */
+      pagedir_clear_page (t->pagedir, uaddr);
       break;
     case PG_IN_SWAP:
       kaddr = frame_get_page (uaddr, PAL_USER);
-      swap_read (entry->swap_sector, kaddr);
+      supt_swap_in (table, entry, uaddr, kaddr);
       break;
     case PG_FILE_MAPPED:
+      if (supt_is_shared (entry))
+        {
+          struct supt_file *sf = entry->filefrom;
+          kaddr = frame_get_shared (uaddr, sf->fl, sf->offset, 
+                                    sf->size_in_page);
+          break;
+        }
+      if (!entry->filefrom->private)
+        return supt_map_cached (table, entry, uaddr);
       kaddr = frame_get_page (uaddr, PAL_USER | PAL_ZERO);
       /* The kaddr is used in load_file_to_page */
       entry->kaddr = kaddr;
@@ -265,65 +380,150 @@ supt_load_page (struct supt_table *table, void *uaddr)
       NOT_REACHED ();
     }
   
-  /* What if the frame is evicted before this? */
-  /* Update: there is a bug. Must keep synchronized */
-  /* Update: the frame is locked in frame_get_page */
-  // frame_set_locked (kaddr);
+  /* The frame is pinned in frame_get_page, it cannot be evicted 
+    before it is installed. */
 
   /* Set the mapping relation to the hardware page table. */
-  if (!pagedir_set_page (t->pagedir, uaddr, kaddr, true))
+  if (!pagedir_set_page (t->pagedir, uaddr, kaddr, entry->writable))
     {
-      frame_free_page (kaddr);
-      goto supt_load_page_err;
+      if (supt_is_shared (entry))
+        {
+          frame_unpin (kaddr);
+          frame_release (kaddr, t, uaddr);
+        }
+      else
+        frame_free_page (kaddr);
+      entry->kaddr = NULL;
+      return NULL;
     }
 
   pagedir_set_dirty (t->pagedir, uaddr, false);
   pagedir_set_dirty (t->pagedir, kaddr, false);
+  /* A page read from its swap slot or file keeps a clean copy there. */
+  frame_set_backed (kaddr, entry->state != PG_ZERO);
+  if (entry->filefrom && !entry->filefrom->private)
+    frame_set_mmapped (kaddr);
   entry->dirty = false;
+  entry->cow = false;
   entry->state = PG_IN_MEM;
   entry->kaddr = kaddr;
+
+  return kaddr;
+}
+
+/* Map the zero frame read-only at uaddr, if the page at uaddr of
+  table is a zero page that is not mapped yet.  Returns true if
+  successful. */
+bool
+supt_map_zero (struct supt_table *table, void *uaddr)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct supt_entry *entry;
+  bool success = false;
+
+  lock_acquire (&table->supt_lock);
+  entry = supt_look_up (table, uaddr);
+  if (entry && entry->state == PG_ZERO && !pagedir_get_page (pd, uaddr))
+    success = pagedir_set_page (pd, uaddr, frame_zero_page (), false);
   lock_release (&table->supt_lock);
-  lock_release (&frame_lock);
 
-  return true;
+  return success;
+}
+
+/* Unmap the zero frame at uaddr of table, the process is going to
+  write there and needs a page of its own.  Returns true if the zero
+  frame was mapped there. */
+bool
+supt_unmap_zero (struct supt_table *table, void *uaddr)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct supt_entry *entry;
+  bool mapped;
 
-supt_load_page_err:
+  lock_acquire (&table->supt_lock);
+  entry = supt_look_up (table, uaddr);
+  mapped = entry && entry->state == PG_ZERO 
+           && pagedir_get_page (pd, uaddr) == frame_zero_page ();
+  if (mapped)
+    pagedir_clear_page (pd, uaddr);
   lock_release (&table->supt_lock);
-  lock_release (&frame_lock);
-  return false;
+
+  return mapped;
+}
+
+/* Map the pages following uaddr after a fault on it, if the faults of
+  the process look sequential.  The window doubles, up to
+  FAULT_AROUND_MAX pages, as long as each fault falls just after the
+  previous window, and falls back to the faulting page alone
+  otherwise.  Only pages backed by a file or by swap are brought in,
+  and only while there are plenty of free frames.  They are left
+  unpinned and not accessed, so they are the first to go if they are
+  not used.  Returns the number of pages mapped. */
+size_t
+supt_fault_around (struct supt_table *table, void *uaddr)
+{
+  size_t mapped = 0, i;
+  
+  lock_acquire (&table->supt_lock);
+
+  if (table->last_fault != NULL && uaddr > table->last_fault
+      && uaddr <= table->last_fault + table->window * PGSIZE)
+    table->window = table->window * 2 < FAULT_AROUND_MAX
+                      ? table->window * 2 : FAULT_AROUND_MAX;
+  else
+    table->window = 1;
+  table->last_fault = uaddr;
+
+  for (i = 1; i < table->window; i++)
+    {
+      struct supt_entry *entry;
+      void *kaddr;
+
+      if (!is_user_vaddr (uaddr + i * PGSIZE)
+          || palloc_user_free_cnt () <= frame_low_wm)
+        break;
+      entry = supt_look_up (table, uaddr + i * PGSIZE);
+      if (!entry)
+        break;
+      if (entry->state != PG_IN_SWAP && entry->state != PG_FILE_MAPPED)
+        continue;
+
+      kaddr = supt_map_entry (table, entry, uaddr + i * PGSIZE);
+      if (!kaddr)
+        break;
+      frame_unpin (kaddr);
+      mapped++;
+    }
+
+  lock_release (&table->supt_lock);
+  return mapped;
 }
 
-/* Set the page at uaddr in the supt table of thread t to SWAP. 
-  The page is freed in the frame allocator. The entry of hardware 
-  page table of the thread is cleared. */
-/* For synchronization purpose (avoid deadlock), you should hold
-  frame_lock before calling this. */
+/* Write the page at uaddr in the supt table of thread t back to swap
+  or to its file.  The entry of hardware page table of the thread is
+  cleared, the frame itself is NOT freed: the caller either frees it
+  or reuses it.
+  The supt_lock of t must be held and the frame must be pinned, so
+  nobody else can touch the page during the write back. */
 bool
 supt_set_swap (struct thread *t, void *uaddr)
 {
   struct supt_entry *entry;
-  bool locked_outside = true;
-
-  if (!lock_held_by_current_thread (&t->supt->supt_lock))
-  {
-    lock_acquire (&t->supt->supt_lock);
-    locked_outside = false;
-  }
-  // printf (" %d thread %d set swap %p\n", thread_current ()->tid, t->tid, uaddr);
+
+  ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+
   entry = supt_look_up (t->supt, uaddr);
-  // ASSERT (entry);
   if (!entry)
-    goto supt_set_swap_err;
-
-  if (entry->state == PG_IN_SWAP || entry->state == PG_FILE_MAPPED)
-    goto supt_set_swap_end;
+    return false;
 
-  supt_update_dirty (entry, t->pagedir);
+  if (entry->state != PG_IN_MEM)
+    return true;
 
-  /* frame_lock and supt_lock may cause dead lock.
-  when a thread is holding the frame_lock to require another thread 
-  to evict one page, but the other thread is holding the supt_lock 
-  and waiting for frame_lock */
+  /* Unmap the page first, the owner faults on it and waits for the
+    supt_lock instead of writing to a page being written back. */
+  supt_update_dirty (entry, t->pagedir, uaddr);
+  supt_detach_private (entry);
+  pagedir_clear_page (t->pagedir, uaddr);
 
   if (!entry->filefrom)
     {
@@ -336,7 +536,12 @@ supt_set_swap (struct thread *t, void *uaddr)
           entry->dirty = true;
         }
       
-      /* Only write dirty page */
+      /* Only write dirty page, never over a slot shared after a fork */
+      if (entry->dirty && swap_slot_shared (entry->swap_sector))
+        {
+          free_swap_slot (entry->swap_sector);
+          entry->swap_sector = swap_get_slot ();
+        }
       if (entry->dirty)
         swap_write (entry->swap_sector, entry->kaddr);
     }
@@ -344,36 +549,228 @@ supt_set_swap (struct thread *t, void *uaddr)
     {
       struct supt_file *sf = entry->filefrom;
       entry->state = PG_FILE_MAPPED;
-      if (entry->dirty)
+      if (entry->dirty && !sf->private)
         file_write_at (sf->fl, entry->kaddr, sf->size_in_page, sf->offset);
     }
 
-  /* The order is crucial */
-  pagedir_clear_page (t->pagedir, uaddr);
-  frame_free_page (entry->kaddr);
-
   entry->dirty = false;
   entry->kaddr = NULL;
 
-supt_set_swap_end:
-  if (!locked_outside)
-    lock_release (&t->supt->supt_lock);
-
-  // printf ("%d set to swap %p \n", t->tid, uaddr);
   return true;
+}
 
-supt_set_swap_err:
+/* Read the page of entry from swap into kaddr.  The following pages
+  of the table whose slots follow its slot are read by the same I/O
+  and mapped too, as long as there are plenty of free frames.  They
+  are left unpinned and not accessed, so they are the first to go if
+  they are not used.  The supt_lock of table must be held. */
+static void
+supt_swap_in (struct supt_table *table, struct supt_entry *entry, 
+              void *uaddr, void *kaddr)
+{
+  struct supt_entry *run[SWAP_CLUSTER];
+  void *pages[SWAP_CLUSTER];
+  uint32_t *pd = thread_current ()->pagedir;
+  size_t cnt, i;
+
+  run[0] = entry;
+  pages[0] = kaddr;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      struct supt_entry *next;
+
+      if (!is_user_vaddr (uaddr + cnt * PGSIZE)
+          || palloc_user_free_cnt () <= frame_low_wm)
+        break;
+      next = supt_look_up (table, uaddr + cnt * PGSIZE);
+      if (!next || next->state != PG_IN_SWAP 
+          || next->swap_sector != entry->swap_sector + cnt * SWAP_SECTORS_PG)
+        break;
+
+      run[cnt] = next;
+      pages[cnt] = frame_get_page (uaddr + cnt * PGSIZE, PAL_USER);
+    }
 
-  if (!locked_outside)
-    lock_release (&t->supt->supt_lock);
+  swap_read_cluster (entry->swap_sector, pages, cnt);
 
-  return false;
+  for (i = 1; i < cnt; i++)
+    {
+      struct supt_entry *e = run[i];
+      void *upage = uaddr + i * PGSIZE;
+
+      if (!pagedir_set_page (pd, upage, pages[i], e->writable))
+        {
+          frame_free_page (pages[i]);
+          continue;
+        }
+      pagedir_set_dirty (pd, upage, false);
+      pagedir_set_dirty (pd, pages[i], false);
+      frame_set_backed (pages[i], true);
+      e->dirty = false;
+      e->state = PG_IN_MEM;
+      e->kaddr = pages[i];
+      frame_unpin (pages[i]);
+    }
+}
+
+/* Write back a batch of cnt pages, the i-th page is at uaddrs[i] in
+  the supt table of owners[i], like supt_set_swap.  The anonymous
+  pages that need a write are written together to a cluster of
+  consecutive swap slots by a single I/O.  The supt_lock of every
+  owner must be held and every frame must be pinned. */
+void
+supt_set_swap_batch (struct thread **owners, void **uaddrs, size_t cnt)
+{
+  struct supt_entry *batch[SWAP_CLUSTER];
+  void *pages[SWAP_CLUSTER];
+  struct pagedir_batch tlb;
+  size_t batch_cnt = 0, i;
+  block_sector_t sector;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  pagedir_batch_begin (&tlb);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct thread *t = owners[i];
+      struct supt_entry *entry;
+
+      ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+      entry = supt_look_up (t->supt, uaddrs[i]);
+      ASSERT (entry && entry->state == PG_IN_MEM);
+
+      supt_update_dirty (entry, t->pagedir, uaddrs[i]);
+      supt_detach_private (entry);
+      if (entry->filefrom)
+        {
+          supt_set_swap (t, uaddrs[i]);
+          continue;
+        }
+
+      pagedir_clear_page (t->pagedir, uaddrs[i]);
+      entry->state = PG_IN_SWAP;
+
+      /* The copy in its slot is still good. */
+      if (entry->swap_sector != SWAP_SECTOR_INIT && !entry->dirty)
+        {
+          entry->kaddr = NULL;
+          continue;
+        }
+
+      /* Move the page into the new cluster. */
+      if (entry->swap_sector != SWAP_SECTOR_INIT)
+        free_swap_slot (entry->swap_sector);
+      batch[batch_cnt] = entry;
+      pages[batch_cnt++] = entry->kaddr;
+    }
+
+  /* No process may reach the frames once they are written back. */
+  pagedir_batch_end (&tlb);
+  if (batch_cnt == 0)
+    return;
+
+  sector = swap_get_cluster (batch_cnt);
+  if (sector != SWAP_SECTOR_INIT)
+    swap_write_cluster (sector, pages, batch_cnt);
+
+  for (i = 0; i < batch_cnt; i++)
+    {
+      if (sector != SWAP_SECTOR_INIT)
+        batch[i]->swap_sector = sector + i * SWAP_SECTORS_PG;
+      else
+        {
+          /* Swap is too fragmented, one slot at a time. */
+          batch[i]->swap_sector = swap_get_slot ();
+          swap_write (batch[i]->swap_sector, pages[i]);
+        }
+      batch[i]->dirty = false;
+      batch[i]->kaddr = NULL;
+    }
+}
+
+/* Write the page at uaddr in the supt table of thread t back to swap
+  or to its file like supt_set_swap, but keep it mapped, so it can be
+  evicted later without a write.
+  The supt_lock of t must be held and the frame must be pinned. */
+void
+supt_clean_page (struct thread *t, void *uaddr)
+{
+  struct supt_entry *entry;
+
+  ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+
+  entry = supt_look_up (t->supt, uaddr);
+  ASSERT (entry && entry->state == PG_IN_MEM);
+
+  supt_update_dirty (entry, t->pagedir, uaddr);
+  supt_detach_private (entry);
+  if (!entry->dirty && entry->filefrom)
+    return;
+
+  /* Clear the dirty bits before the write, so a write by the owner
+    during the I/O makes the page dirty again. */
+  pagedir_set_dirty (t->pagedir, uaddr, false);
+  pagedir_set_dirty (t->pagedir, entry->kaddr, false);
+
+  if (!entry->filefrom)
+    {
+      if (entry->swap_sector != SWAP_SECTOR_INIT 
+          && swap_slot_shared (entry->swap_sector))
+        {
+          free_swap_slot (entry->swap_sector);
+          entry->swap_sector = SWAP_SECTOR_INIT;
+        }
+      if (entry->swap_sector == SWAP_SECTOR_INIT)
+        entry->swap_sector = swap_get_slot ();
+      swap_write (entry->swap_sector, entry->kaddr);
+    }
+  else
+    {
+      struct supt_file *sf = entry->filefrom;
+      file_write_at (sf->fl, entry->kaddr, sf->size_in_page, sf->offset);
+    }
+
+  entry->dirty = false;
+}
+
+/* Write the dirty pages of the file map of SIZE bytes at UADDR of the
+  current thread back to the file.  The clean pages are skipped.
+  Unless SYNC, the pages mapped from the page cache are only marked
+  dirty there, for the flusher to write them back. */
+void
+supt_msync (struct supt_table *table, void *uaddr, off_t size, bool sync)
+{
+  struct thread *t = thread_current ();
+  uintptr_t base;
+
+  lock_acquire (&table->supt_lock);
+  for (base = (uintptr_t) uaddr; base < (uintptr_t) uaddr + size; 
+       base += PGSIZE)
+    {
+      struct supt_entry *entry = supt_look_up (table, (void *) base);
+
+      /* Nobody can be evicting it since we hold the supt_lock. */
+      if (entry && entry->state == PG_IN_MEM && sync)
+        supt_clean_page (t, (void *) base);
+      else if (entry && entry->state == PG_IN_CACHE)
+        {
+          struct supt_file *sf = entry->filefrom;
+          bool dirty = pagedir_is_dirty (t->pagedir, (void *) base);
+
+          pagedir_set_dirty (t->pagedir, (void *) base, false);
+          pagecache_sync (file_get_inode (sf->fl), sf->offset / PGSIZE,
+                          dirty, sync);
+        }
+    }
+  lock_release (&table->supt_lock);
 }
 
 /* Avoid page fault on writing or reading to file system 
   by load the memory required in advance. */
 bool 
-supt_preload_mem (struct supt_table *table, void *uaddr, void *esp, size_t size)
+supt_preload_mem (struct supt_table *table, void *uaddr, void *esp, 
+                  size_t size, bool write)
 {
   uintptr_t base = (uintptr_t) pg_round_down (uaddr);
 
@@ -390,6 +787,10 @@ supt_preload_mem (struct supt_table *table, void *uaddr, void *esp, size_t size)
 
       if (!supt_load_page (table, (void *)base))
         return false;
+      /* The kernel is going to write there, copy it now rather than
+        in a page fault in the middle of the system call. */
+      if (write)
+        supt_break_cow (table, (void *)base, true);
       base += PGSIZE;
     }
 
@@ -403,19 +804,17 @@ supt_unlock_mem (struct supt_table *table, void *uaddr, size_t size)
   uintptr_t base = (uintptr_t) pg_round_down (uaddr);
   void *kaddr;
 
-  lock_acquire (&frame_lock);
   lock_acquire (&table->supt_lock);
   
   while (base <= (uintptr_t)(uaddr + size))
     {
       kaddr = supt_look_up (table, (void *)base)->kaddr;
       ASSERT (kaddr);
-      frame_set_unlocked (kaddr);
+      frame_unpin (kaddr);
       base += PGSIZE;
     }
     
   lock_release (&table->supt_lock);  
-  lock_release (&frame_lock);
 }
 
 /* Check if ANY page starts from uaddr with size is exist. */
@@ -443,6 +842,79 @@ supt_check_exist (struct supt_table *table, void *uaddr, size_t size)
   return false;
 }
 
+/* Map the page cache page holding the page of ENTRY, a page of a
+  memory mapped file, at UADDR of TABLE, the supt of the current
+  thread.  Every process mapping the file shares the page, and
+  writes to it reach the file through the page cache.  Returns the
+  page, pinned, or NULL on failure. */
+static void *
+supt_map_cached (struct supt_table *table, struct supt_entry *entry,
+                 void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct supt_file *sf = entry->filefrom;
+  struct inode *inode = file_get_inode (sf->fl);
+  void *kaddr;
+
+  /* A file map starts at offset 0 of its file. */
+  ASSERT (sf->offset % PGSIZE == 0);
+  while ((kaddr = frame_get_cached (uaddr, inode, sf->offset / PGSIZE))
+         == NULL)
+    {
+      /* The processes mapping the cold pages are busy.  They may be
+        waiting for our supt_lock to unmap our pages in turn.  Only
+        this thread and evictors use the supt, and evictors leave
+        ENTRY alone, it is not in memory. */
+      lock_release (&table->supt_lock);
+      thread_yield ();
+      lock_acquire (&table->supt_lock);
+    }
+  if (!pagedir_set_page (t->pagedir, uaddr, kaddr, entry->writable))
+    {
+      frame_unpin (kaddr);
+      frame_release_cached (kaddr, t, uaddr);
+      pagecache_unmap (inode, sf->offset / PGSIZE, false);
+      return NULL;
+    }
+
+  pagedir_set_dirty (t->pagedir, uaddr, false);
+  entry->dirty = false;
+  entry->cow = false;
+  entry->state = PG_IN_CACHE;
+  entry->kaddr = kaddr;
+  return kaddr;
+}
+
+/* Unmap the page cache page at UADDR of thread T, which the page
+  cache needs for another page.  The supt_lock of T must be held. */
+void
+supt_evict_cached (struct thread *t, void *uaddr)
+{
+  struct supt_entry *entry;
+
+  ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+
+  entry = supt_look_up (t->supt, uaddr);
+  ASSERT (entry && entry->state == PG_IN_CACHE);
+  supt_unmap_cached (entry, t->pagedir, uaddr);
+}
+
+/* Unmap the page cache page of ENTRY at UADDR of page directory PD,
+  handing what the process wrote there to the page cache. */
+static void
+supt_unmap_cached (struct supt_entry *entry, uint32_t *pd, void *uaddr)
+{
+  struct supt_file *sf = entry->filefrom;
+  bool dirty = pagedir_is_dirty (pd, uaddr);
+
+  /* The page belongs to the page cache, pagedir_destroy must not
+    free it. */
+  pagedir_clear_page (pd, uaddr);
+  pagecache_unmap (file_get_inode (sf->fl), sf->offset / PGSIZE, dirty);
+  entry->state = PG_FILE_MAPPED;
+  entry->kaddr = NULL;
+}
+
 /* Load the file associated to the page entry with uaddr to the page */
 static void 
 load_file_to_page (struct supt_table *table, void *uaddr)
@@ -459,10 +931,247 @@ load_file_to_page (struct supt_table *table, void *uaddr)
   file_read_at (sf->fl, entry->kaddr, sf->size_in_page, sf->offset);
 }
 
+/* Returns true if the page of entry lives in a frame shared with the
+  other processes running the same executable: a read-only page of an
+  executable segment. */
+static bool
+supt_is_shared (struct supt_entry *entry)
+{
+  return entry->filefrom && entry->filefrom->private && !entry->writable;
+}
+
+/* The shared frame at uaddr of thread t is being evicted, unmap it.
+  The supt_lock of t must be held. */
+void
+supt_unmap_shared (struct thread *t, void *uaddr)
+{
+  struct supt_entry *entry;
+
+  ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+
+  entry = supt_look_up (t->supt, uaddr);
+  ASSERT (entry && entry->state == PG_IN_MEM && supt_is_shared (entry));
+
+  pagedir_clear_page (t->pagedir, uaddr);
+  entry->state = PG_FILE_MAPPED;
+  entry->kaddr = NULL;
+}
+
+/* Returns false if any page from uaddr with size exists and is not
+  writable by the user process. */
+bool
+supt_check_writable (struct supt_table *table, void *uaddr, size_t size)
+{
+  uintptr_t base = (uintptr_t) pg_round_down (uaddr);
+  struct supt_entry *entry;
+  bool writable = true;
+
+  lock_acquire (&table->supt_lock);
+  while (writable && base <= (uintptr_t)(uaddr + size))
+    {
+      entry = supt_look_up (table, (void *)base);
+      if (entry && !entry->writable)
+        writable = false;
+      base += PGSIZE;
+    }
+  lock_release (&table->supt_lock);
+  return writable;
+}
+
+/* Give the current process its own copy of the copy on write page at
+  uaddr of table, it is written to.  If pinned, the page has been
+  pinned by the caller, and the copy is pinned instead.  Returns false
+  if the page is not a copy on write page in memory. */
+bool
+supt_break_cow (struct supt_table *table, void *uaddr, bool pinned)
+{
+  struct thread *t = thread_current ();
+  struct supt_entry *entry;
+  void *kaddr;
+
+  lock_acquire (&table->supt_lock);
+  entry = supt_look_up (table, uaddr);
+  if (!entry || entry->state != PG_IN_MEM || !entry->cow)
+    {
+      lock_release (&table->supt_lock);
+      return false;
+    }
+
+  supt_update_dirty (entry, t->pagedir, uaddr);
+  if (frame_cow_take (entry->kaddr, t, uaddr))
+    pagedir_set_writable (t->pagedir, uaddr, true);
+  else
+    {
+      /* Direct reclaim in frame_get_page could evict the frame
+        being copied. */
+      if (!pinned)
+        frame_pin (entry->kaddr);
+      kaddr = frame_get_page (uaddr, PAL_USER);
+      memcpy (kaddr, entry->kaddr, PGSIZE);
+      frame_unpin (entry->kaddr);
+      frame_release (entry->kaddr, t, uaddr);
+
+      pagedir_clear_page (t->pagedir, uaddr);
+      if (!pagedir_set_page (t->pagedir, uaddr, kaddr, true))
+        PANIC ("supt_break_cow: out of page table memory");
+      entry->kaddr = kaddr;
+      /* The copy has no good copy in swap yet. */
+      entry->dirty = true;
+      if (!pinned)
+        frame_unpin (kaddr);
+    }
+  entry->cow = false;
+
+  lock_release (&table->supt_lock);
+  return true;
+}
+
+/* Duplicate the supt of parent into child, for fork.  The pages in
+  memory are mapped in the child too and shared copy on write, the
+  pages in swap share their swap slot.  Memory mapped files are not
+  inherited.  The child's executable must be open in child->elf, its
+  pages refer to it. */
+bool
+supt_fork (struct thread *parent, struct thread *child)
+{
+  struct supt_table *ptable = parent->supt;
+  struct supt_table *ctable = child->supt;
+  struct pagedir_batch batch;
+  bool success = true;
+  size_t c, j;
+
+  lock_acquire (&ptable->supt_lock);
+  lock_acquire (&ctable->supt_lock);
+
+  /* Every writable page of the parent becomes read-only. */
+  pagedir_batch_begin (&batch);
+
+  for (c = 0; success && c < SUPT_DIR_CNT * SUPT_GROUP_CNT; c++)
+    {
+      struct supt_entry *chunk = supt_chunk (ptable, c);
+
+      for (j = 0; success && chunk != NULL && j < SUPT_CHUNK_CNT; j++)
+        {
+          struct supt_entry *entry = &chunk[j];
+          void *uaddr = supt_uaddr (c, j);
+          struct supt_entry *copy;
+
+          if (entry->state == PG_NONE
+              || (entry->filefrom && !entry->filefrom->private))
+            continue;
+
+          copy = supt_slot (ctable, uaddr, true);
+          if (!copy)
+            {
+              success = false;
+              break;
+            }
+
+          if (entry->state == PG_IN_MEM)
+            {
+              if (!pagedir_set_page (child->pagedir, uaddr, entry->kaddr,
+                                     false))
+                {
+                  success = false;
+                  break;
+                }
+              if (!supt_is_shared (entry))
+                {
+                  supt_update_dirty (entry, parent->pagedir, uaddr);
+                  if (entry->writable)
+                    {
+                      pagedir_set_writable (parent->pagedir, uaddr, false);
+                      entry->cow = true;
+                    }
+                }
+              frame_add_mapping (entry->kaddr, child, uaddr);
+            }
+
+          *copy = *entry;
+          if (entry->filefrom)
+            {
+              copy->filefrom = malloc (sizeof *copy->filefrom);
+              ASSERT (copy->filefrom);
+              *copy->filefrom = *entry->filefrom;
+              copy->filefrom->fl = child->elf;
+            }
+          if (copy->swap_sector != SWAP_SECTOR_INIT)
+            swap_dup_slot (copy->swap_sector);
+        }
+    }
+
+  pagedir_batch_end (&batch);
+  lock_release (&ctable->supt_lock);
+  lock_release (&ptable->supt_lock);
+  return success;
+}
+
+/* Called for each process mapping a copy on write frame being
+  evicted, before the write back.  Returns true if the page of
+  thread t at uaddr has no good copy in swap or in its file. */
+bool
+supt_cow_needs_write (struct thread *t, void *uaddr)
+{
+  struct supt_entry *entry;
+
+  ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+
+  entry = supt_look_up (t->supt, uaddr);
+  ASSERT (entry && entry->state == PG_IN_MEM);
+
+  supt_update_dirty (entry, t->pagedir, uaddr);
+  return entry->dirty
+         || (!entry->filefrom && entry->swap_sector == SWAP_SECTOR_INIT);
+}
+
+/* The copy on write frame at uaddr of thread t has been evicted.  If
+  sector is not SWAP_SECTOR_INIT, the frame was written there and
+  the page moves to this slot, shared with the other processes. */
+void
+supt_cow_evicted (struct thread *t, void *uaddr, block_sector_t sector)
+{
+  struct supt_entry *entry;
+
+  ASSERT (lock_held_by_current_thread (&t->supt->supt_lock));
+
+  entry = supt_look_up (t->supt, uaddr);
+  ASSERT (entry && entry->state == PG_IN_MEM);
+
+  pagedir_clear_page (t->pagedir, uaddr);
+  if (sector != SWAP_SECTOR_INIT)
+    {
+      if (entry->filefrom)
+        {
+          free (entry->filefrom);
+          entry->filefrom = NULL;
+        }
+      if (entry->swap_sector != SWAP_SECTOR_INIT)
+        free_swap_slot (entry->swap_sector);
+      swap_dup_slot (sector);
+      entry->swap_sector = sector;
+    }
+  entry->state = entry->filefrom ? PG_FILE_MAPPED : PG_IN_SWAP;
+  entry->kaddr = NULL;
+  entry->dirty = false;
+  entry->cow = false;
+}
+
+/* A private file page that has been written is not backed by its
+  file anymore, from now on it is anonymous memory. */
+static void
+supt_detach_private (struct supt_entry *entry)
+{
+  if (entry->filefrom && entry->filefrom->private && entry->dirty)
+    {
+      free (entry->filefrom);
+      entry->filefrom = NULL;
+    }
+}
+
 /* Update the dirty bit on supt_entry by looking up the pagedir. */
 static void 
-supt_update_dirty (struct supt_entry *entry, uint32_t *pd)
+supt_update_dirty (struct supt_entry *entry, uint32_t *pd, void *uaddr)
 {
-  entry->dirty = entry->dirty || pagedir_is_dirty (pd, entry->uaddr);
+  entry->dirty = entry->dirty || pagedir_is_dirty (pd, uaddr);
   entry->dirty = entry->dirty || pagedir_is_dirty (pd, entry->kaddr);
 }
@@ -2,16 +2,18 @@
 #define VM_PAGE_H
 
 #include "swap.h"
-#include "lib/kernel/hash.h"
 #include "threads/synch.h"
+#include "threads/pte.h"
 #include "filesys/file.h"
 
 enum page_state 
   {
+    PG_NONE,            /* No page, an empty slot. */
     PG_ZERO,
     PG_IN_MEM,
     PG_IN_SWAP,
     PG_FILE_MAPPED,
+    PG_IN_CACHE,        /* A page cache page of the mapped file. */
   };
 
 struct supt_file
@@ -19,31 +21,59 @@ struct supt_file
     struct file *fl;
     off_t offset;
     off_t size_in_page;
+
+    /* A private mapping (an executable segment) is never written back
+      to the file.  Once written, the page becomes anonymous. */
+    bool private;
   };
 
+/* A page of the supt.  Entries are kept in page-sized chunks, their
+  user address is given by their position, see struct supt_table. */
 struct supt_entry 
   {
-    void *uaddr;
     void *kaddr;
-
-    bool dirty;
     block_sector_t swap_sector;
 
-    enum page_state state;
-
     /* The memory mapped file description */
     struct supt_file *filefrom;
 
-    struct hash_elem elem;
+    uint8_t state;              /* enum page_state. */
+    bool dirty;
+
+    /* False if the user process may only read the page. */
+    bool writable;
+
+    /* The page is writable but mapped read-only, since its frame is
+      shared copy on write after a fork. */
+    bool cow;
   };
 
+/* A chunk of supt entries fills a page and covers
+  SUPT_CHUNK_CNT pages of user memory. */
+#define SUPT_CHUNK_BITS 8
+#define SUPT_CHUNK_CNT (1 << SUPT_CHUNK_BITS)
+
+/* Chunks in the span of a page table, and number of page
+  directory entries covering the user address space. */
+#define SUPT_GROUP_BITS (PTBITS - SUPT_CHUNK_BITS)
+#define SUPT_GROUP_CNT (1 << SUPT_GROUP_BITS)
+#define SUPT_DIR_CNT (LOADER_PHYS_BASE >> PDSHIFT)
+
 struct supt_table 
   {
-    /* Use hash table as the data structure for supplemental hash table. */
-    struct hash supt_hash;
+    /* Indexed like the page directory of the CPU: dir[i] holds the
+      chunks of entries of the pages from i << PDSHIFT on, or is
+      NULL.  It and each chunk are allocated on the first page
+      installed in their span. */
+    struct supt_entry **dir[SUPT_DIR_CNT];
 
     /* Lock to keep supl synchronized. */
     struct lock supt_lock;
+
+    /* Last page faulted on and the fault-around window in pages, see
+      supt_fault_around. */
+    void *last_fault;
+    size_t window;
   };
 
 struct supt_table *supt_create (void);
@@ -52,6 +82,9 @@ bool supt_install_page (struct supt_table *table, void *uaddr, void *kaddr,
                           enum page_state state);
 bool supt_install_filemap (struct supt_table *table, void *uaddr,  
                         struct file *fl, off_t offset, off_t size);
+bool supt_install_execmap (struct supt_table *table, void *uaddr,
+                        struct file *fl, off_t offset, off_t size,
+                        bool writable);
 
 void supt_remove_filemap (struct supt_table *table, void *uaddr, off_t size);
 void supt_delete_entry (struct supt_table *table, void *uaddr);
@@ -60,11 +93,27 @@ bool supt_contains (struct supt_table *table, void *uaddr);
 struct supt_entry *supt_look_up (struct supt_table *table, void *uaddr);
 
 bool supt_load_page (struct supt_table *table, void *uaddr);
+size_t supt_fault_around (struct supt_table *table, void *uaddr);
+bool supt_map_zero (struct supt_table *table, void *uaddr);
+bool supt_unmap_zero (struct supt_table *table, void *uaddr);
 bool supt_set_swap (struct thread *t, void *uaddr);
-
-bool supt_preload_mem (struct supt_table *table, void *uaddr, void *esp, size_t size);
+void supt_set_swap_batch (struct thread **owners, void **uaddrs, size_t cnt);
+void supt_clean_page (struct thread *t, void *uaddr);
+void supt_msync (struct supt_table *table, void *uaddr, off_t size,
+                 bool sync);
+void supt_unmap_shared (struct thread *t, void *uaddr);
+void supt_evict_cached (struct thread *t, void *uaddr);
+
+bool supt_fork (struct thread *parent, struct thread *child);
+bool supt_break_cow (struct supt_table *table, void *uaddr, bool pinned);
+bool supt_cow_needs_write (struct thread *t, void *uaddr);
+void supt_cow_evicted (struct thread *t, void *uaddr, block_sector_t sector);
+
+bool supt_preload_mem (struct supt_table *table, void *uaddr, void *esp,
+                       size_t size, bool write);
 void supt_unlock_mem (struct supt_table *table, void *uaddr, size_t size);
 
 bool supt_check_exist (struct supt_table *table, void *uaddr, size_t size);
+bool supt_check_writable (struct supt_table *table, void *uaddr, size_t size);
 
 #endif
\ No newline at end of file
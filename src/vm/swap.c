@@ -1,82 +1,254 @@
 #include "swap.h"
+#include "zswap.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/malloc.h"
 #include "lib/kernel/bitmap.h"
 #include <stdio.h>
+#include <string.h>
 #include "threads/thread.h"
 #include "threads/synch.h"
 
-#define SLOTSIZE PGSIZE
-#define SECTORS_PG (SLOTSIZE / BLOCK_SECTOR_SIZE)
-
 struct swap_struct 
   {
+    struct lock swap_lock;        /* Protects swap_used_map and next_slot. */
     struct bitmap *swap_used_map;
+    uint16_t *swap_refs;          /* # of pages sharing each slot. */
     struct block *swap_block;
     size_t swap_size;
+
+    /* Next fit: slots are handed out from here on, so consecutive
+      allocations get consecutive slots. */
+    size_t next_slot;
+
+    /* Bounce buffer for the cluster I/O, SWAP_CLUSTER pages. */
+    struct lock cluster_lock;
+    uint8_t *cluster_buf;
   };
 
 static struct swap_struct swap;
 
+/* Statistics. */
+static long long cluster_write_cnt;   /* # of cluster writes. */
+static long long cluster_write_pages; /* # of pages written by them. */
+static long long cluster_read_cnt;    /* # of cluster reads. */
+static long long cluster_read_pages;  /* # of pages read by them. */
+
 /* Initialize the swap */
 void 
 swap_init ()
 {
   swap.swap_block = block_get_role (BLOCK_SWAP);
-  swap.swap_size = block_size (swap.swap_block) / SECTORS_PG;
+  swap.swap_size = block_size (swap.swap_block) / SWAP_SECTORS_PG;
   swap.swap_used_map = bitmap_create (swap.swap_size);
+  swap.swap_refs = calloc (swap.swap_size, sizeof *swap.swap_refs);
 
   ASSERT (swap.swap_block);
   ASSERT (swap.swap_used_map);
+  ASSERT (swap.swap_refs);
   
   bitmap_set_all(swap.swap_used_map, false);
+  lock_init (&swap.swap_lock);
+  swap.next_slot = 0;
+
+  lock_init (&swap.cluster_lock);
+  swap.cluster_buf = palloc_get_multiple (PAL_ASSERT, SWAP_CLUSTER);
+
+  zswap_init ();
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld cluster writes (%lld pages), "
+          "%lld cluster reads (%lld pages)\n",
+          cluster_write_cnt, cluster_write_pages,
+          cluster_read_cnt, cluster_read_pages);
+  zswap_print_stats ();
 }
 
 block_sector_t 
 swap_get_slot () 
 {
-  size_t available = bitmap_scan (swap.swap_used_map, 0, 1, false);
+  block_sector_t sector = swap_get_cluster (1);
+
   /* No available swap space */
-  ASSERT (available != BITMAP_ERROR);
-  bitmap_set (swap.swap_used_map, available, true);
-  return available * SECTORS_PG;
+  ASSERT (sector != SWAP_SECTOR_INIT);
+  return sector;
 }
 
-/* Write the page in uaddr to swap partition */
+/* Get CNT consecutive swap slots, returns the first sector of the
+  first slot or SWAP_SECTOR_INIT if there is no such free run. */
+block_sector_t
+swap_get_cluster (size_t cnt)
+{
+  size_t available;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  lock_acquire (&swap.swap_lock);
+  available = bitmap_scan_and_flip (swap.swap_used_map, swap.next_slot,
+                                    cnt, false);
+  if (available == BITMAP_ERROR)
+    available = bitmap_scan_and_flip (swap.swap_used_map, 0, cnt, false);
+  if (available != BITMAP_ERROR)
+    {
+      size_t i;
+      for (i = 0; i < cnt; i++)
+        swap.swap_refs[available + i] = 1;
+      swap.next_slot = available + cnt;
+      if (swap.next_slot >= swap.swap_size)
+        swap.next_slot = 0;
+    }
+  lock_release (&swap.swap_lock);
+
+  if (available == BITMAP_ERROR)
+    return SWAP_SECTOR_INIT;
+  return available * SWAP_SECTORS_PG;
+}
+
+/* Write the page in uaddr to swap partition, or to the compressed
+  swap cache if it takes it. */
 void
 swap_write (block_sector_t sector, void *addr)
 {
-  size_t idx;
-
   ASSERT (sector != SWAP_SECTOR_INIT);
   ASSERT (pg_ofs (addr) == 0);
-  /* Write SECTORS_PG block sectors consecutively */
-  for (idx = 0; idx < SECTORS_PG; idx++)
-    block_write (swap.swap_block, sector + idx, 
-                  (void *)((char *)addr + (BLOCK_SECTOR_SIZE * idx)));
+  if (!zswap_store (sector, addr))
+    block_write_multiple (swap.swap_block, sector, SWAP_SECTORS_PG, addr);
 }
 
 /* Read the page in swap partition to addr */
 void 
 swap_read (block_sector_t sector, void *addr)
 {
-  size_t idx;
-
   ASSERT (sector != SWAP_SECTOR_INIT);
   ASSERT (pg_ofs (addr) == 0);
-  /* Read SECTORS_PG block sectors consecutively */
-  for (idx = 0; idx < SECTORS_PG; idx++)
-    block_read (swap.swap_block, sector + idx, 
-                  (void *)((char *)addr + (BLOCK_SECTOR_SIZE * idx)));
+  if (!zswap_load (sector, addr))
+    block_read_multiple (swap.swap_block, sector, SWAP_SECTORS_PG, addr);
+}
+
+/* Write the CNT pages in PAGES to the consecutive slots starting at
+  SECTOR.  The pages the compressed swap cache does not take are
+  written with a single I/O per run of consecutive slots. */
+void
+swap_write_cluster (block_sector_t sector, void **pages, size_t cnt)
+{
+  size_t i, run = 0;
+
+  ASSERT (sector != SWAP_SECTOR_INIT);
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  if (cnt == 1)
+    {
+      swap_write (sector, pages[0]);
+      return;
+    }
+
+  lock_acquire (&swap.cluster_lock);
+  for (i = 0; i <= cnt; i++)
+    {
+      if (i < cnt && !zswap_store (sector + i * SWAP_SECTORS_PG, pages[i]))
+        {
+          memcpy (swap.cluster_buf + run * PGSIZE, pages[i], PGSIZE);
+          run++;
+          continue;
+        }
+      if (run == 0)
+        continue;
+
+      /* Write out the run of pages just before page i. */
+      block_write_multiple (swap.swap_block, 
+                            sector + (i - run) * SWAP_SECTORS_PG,
+                            run * SWAP_SECTORS_PG, swap.cluster_buf);
+      cluster_write_cnt++;
+      cluster_write_pages += run;
+      run = 0;
+    }
+  lock_release (&swap.cluster_lock);
+}
+
+/* Read the CNT consecutive slots starting at SECTOR into PAGES.  The
+  pages missing from the compressed swap cache are read with a single
+  I/O. */
+void
+swap_read_cluster (block_sector_t sector, void **pages, size_t cnt)
+{
+  bool hit[SWAP_CLUSTER];
+  size_t i, miss = 0;
+
+  ASSERT (sector != SWAP_SECTOR_INIT);
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  if (cnt == 1)
+    {
+      swap_read (sector, pages[0]);
+      return;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      hit[i] = zswap_load (sector + i * SWAP_SECTORS_PG, pages[i]);
+      if (!hit[i])
+        miss++;
+    }
+  if (miss == 0)
+    return;
+
+  lock_acquire (&swap.cluster_lock);
+  block_read_multiple (swap.swap_block, sector, cnt * SWAP_SECTORS_PG,
+                       swap.cluster_buf);
+  for (i = 0; i < cnt; i++)
+    if (!hit[i])
+      memcpy (pages[i], swap.cluster_buf + i * PGSIZE, PGSIZE);
+  cluster_read_cnt++;
+  cluster_read_pages += cnt;
+  lock_release (&swap.cluster_lock);
+}
+
+/* Another page shares the swap slot at SECTOR, copy on write
+  after a fork.  The slot is freed when every page sharing it has
+  called free_swap_slot. */
+void
+swap_dup_slot (block_sector_t sector)
+{
+  size_t slot = sector / SWAP_SECTORS_PG;
+
+  lock_acquire (&swap.swap_lock);
+  ASSERT (bitmap_test (swap.swap_used_map, slot));
+  swap.swap_refs[slot]++;
+  lock_release (&swap.swap_lock);
+}
+
+/* Returns true if more than one page shares the swap slot at
+  SECTOR.  Such a slot must not be written. */
+bool
+swap_slot_shared (block_sector_t sector)
+{
+  size_t slot = sector / SWAP_SECTORS_PG;
+  bool shared;
+
+  lock_acquire (&swap.swap_lock);
+  shared = swap.swap_refs[slot] > 1;
+  lock_release (&swap.swap_lock);
+  return shared;
 }
 
 /* free the swap slot */
 void 
 free_swap_slot (block_sector_t sector) 
 {
-  size_t available = sector / SECTORS_PG;
+  size_t available = sector / SWAP_SECTORS_PG;
+
+  lock_acquire (&swap.swap_lock);
   ASSERT (bitmap_test (swap.swap_used_map, available))
-  bitmap_set (swap.swap_used_map, available, false);
+  if (--swap.swap_refs[available] == 0)
+    {
+      /* Drop the cached copy before anyone can get the slot again. */
+      zswap_invalidate (sector);
+      bitmap_set (swap.swap_used_map, available, false);
+    }
+  lock_release (&swap.swap_lock);
 }
-
@@ -2,15 +2,28 @@
 #define VM_SWAP_H
 
 #include "devices/block.h"
+#include "threads/vaddr.h"
 
 #define SWAP_SECTOR_INIT 0xFFFFFFFF
 
+/* Number of sectors in a swap slot, a slot holds one page. */
+#define SWAP_SECTORS_PG (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Maximum number of pages moved by one swap I/O. */
+#define SWAP_CLUSTER 8
+
 void swap_init (void);
+void swap_print_stats (void);
 
 block_sector_t swap_get_slot (void);
+block_sector_t swap_get_cluster (size_t cnt);
 void swap_write (block_sector_t sector, void *addr);
 void swap_read (block_sector_t sector, void *addr);
+void swap_write_cluster (block_sector_t sector, void **pages, size_t cnt);
+void swap_read_cluster (block_sector_t sector, void **pages, size_t cnt);
 
+void swap_dup_slot (block_sector_t sector);
+bool swap_slot_shared (block_sector_t sector);
 void free_swap_slot (block_sector_t sector);
 
-#endif
\ No newline at end of file
+#endif
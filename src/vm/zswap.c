@@ -0,0 +1,436 @@
+#include "zswap.h"
+#include <debug.h>
+#include <stdio.h>
+#include <round.h>
+#include <string.h>
+#include "lib/kernel/bitmap.h"
+#include "lib/kernel/hash.h"
+#include "lib/kernel/list.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A compressed swap cache in front of the swap device.  A page
+  written to a swap slot is compressed into an arena of kernel pool
+  pages instead, as long as it compresses well and the arena has
+  room within its budget, and it is read back from there.  The swap
+  slot is still allocated, a page that does not fit in the cache
+  spills to it.
+
+  Each arena page is cut into ZSWAP_CHUNK_CNT chunks.  The first one
+  holds the page's header, a compressed page takes a run of the
+  others, found in the header's bitmap, and an arena page that
+  becomes empty goes back to the kernel pool.  The budget counts
+  arena pages, so the cache never holds more than zswap_pages of
+  the kernel pool.
+
+  Pages are compressed with a small LZ77 in the format of LZF:
+  a control byte below 32 is followed by that many plus one literal
+  bytes, otherwise its top 3 bits are the length of a back
+  reference minus 2 (7 means another length byte follows), and its
+  low 5 bits with the next byte are the distance minus 1. */
+
+size_t zswap_pages;
+
+/* A page stored in the cache, at the start of its run of chunks. */
+struct zswap_entry
+  {
+    block_sector_t sector;        /* First sector of its swap slot. */
+    size_t size;                  /* Size of the compressed data. */
+    struct hash_elem elem;
+    uint8_t data[];               /* Compressed data. */
+  };
+
+/* Chunks of an arena page. */
+#define ZSWAP_CHUNK_CNT 64
+#define ZSWAP_CHUNK (PGSIZE / ZSWAP_CHUNK_CNT)
+
+/* Header of an arena page, in its first chunk. */
+struct zswap_page
+  {
+    struct list_elem elem;        /* Element in zswap_arena. */
+    size_t free_cnt;              /* Number of free chunks. */
+    struct bitmap *used;          /* Chunks in use, in USED_BUF. */
+    uint8_t used_buf[32];
+  };
+
+/* Pages compressing to more than this are left to the device. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Size of the hash table of the compressor, in bits. */
+#define LZ_HLOG 10
+
+/* Protects everything below. */
+static struct lock zswap_lock;
+
+/* Compressed pages by sector. */
+static struct hash zswap_table;
+
+/* Arena pages, at most zswap_pages of them. */
+static struct list zswap_arena;
+static size_t zswap_arena_cnt;
+
+/* Scratch space for the compressor. */
+static uint8_t *zswap_buf;
+static uint16_t lz_htab[1 << LZ_HLOG];
+
+/* Statistics. */
+static long long store_cnt;     /* # of pages stored. */
+static long long reject_cnt;    /* # of pages that did not compress. */
+static long long full_cnt;      /* # of pages spilled with a full cache. */
+static long long load_hit_cnt;  /* # of reads served by the cache. */
+static long long load_miss_cnt; /* # of reads that went to the device. */
+static long long store_bytes;   /* Compressed bytes of stored pages. */
+
+static size_t lz_compress (const uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t out_max);
+static bool lz_decompress (const uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t out_len);
+static struct zswap_entry *zswap_find (block_sector_t sector);
+static struct zswap_entry *zswap_alloc (size_t size);
+static void zswap_remove (struct zswap_entry *entry);
+
+static unsigned
+zswap_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct zswap_entry *entry = hash_entry (e, struct zswap_entry, elem);
+  return hash_int (entry->sector);
+}
+
+static bool
+zswap_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return hash_entry (a, struct zswap_entry, elem)->sector
+         < hash_entry (b, struct zswap_entry, elem)->sector;
+}
+
+/* Initialize the compressed swap cache, if it is enabled. */
+void
+zswap_init (void)
+{
+  ASSERT (sizeof (struct zswap_page) <= ZSWAP_CHUNK);
+  ASSERT (bitmap_buf_size (ZSWAP_CHUNK_CNT)
+          <= sizeof ((struct zswap_page *) NULL)->used_buf);
+
+  lock_init (&zswap_lock);
+  hash_init (&zswap_table, zswap_hash, zswap_less, NULL);
+  list_init (&zswap_arena);
+  if (zswap_pages > 0)
+    zswap_buf = palloc_get_page (PAL_ASSERT);
+}
+
+/* Prints compressed swap cache statistics. */
+void
+zswap_print_stats (void)
+{
+  if (zswap_pages == 0)
+    return;
+  printf ("Zswap: %lld pages stored, %lld incompressible, %lld spilled, "
+          "%lld%% compressed size\n",
+          store_cnt, reject_cnt, full_cnt,
+          store_cnt > 0 ? store_bytes * 100 / (store_cnt * PGSIZE) : 0);
+  printf ("Zswap: %zu pages held in %zu arena pages, "
+          "%zu at most\n", hash_size (&zswap_table), zswap_arena_cnt,
+          zswap_pages);
+  printf ("Zswap: %lld reads hit, %lld missed\n",
+          load_hit_cnt, load_miss_cnt);
+}
+
+/* Store the page at PAGE, to be written to the swap slot at SECTOR,
+  in the cache.  Any older copy of the slot is dropped.  Returns
+  false if the page must be written to the device instead. */
+bool
+zswap_store (block_sector_t sector, const void *page)
+{
+  struct zswap_entry *entry;
+  size_t size;
+
+  if (zswap_pages == 0)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  entry = zswap_find (sector);
+  if (entry != NULL)
+    zswap_remove (entry);
+
+  size = lz_compress (page, PGSIZE, zswap_buf, ZSWAP_MAX_SIZE);
+  if (size == 0)
+    {
+      reject_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  entry = zswap_alloc (size);
+  if (entry == NULL)
+    {
+      full_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  entry->sector = sector;
+  entry->size = size;
+  memcpy (entry->data, zswap_buf, size);
+  hash_insert (&zswap_table, &entry->elem);
+  store_cnt++;
+  store_bytes += size;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Read the page of the swap slot at SECTOR into PAGE from the cache.
+  Returns false if it is not there.  The cache keeps its copy, the
+  slot stays valid until it is written again or freed. */
+bool
+zswap_load (block_sector_t sector, void *page)
+{
+  struct zswap_entry *entry;
+  bool success;
+
+  if (zswap_pages == 0)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  entry = zswap_find (sector);
+  success = entry != NULL;
+  if (success)
+    {
+      if (!lz_decompress (entry->data, entry->size, page, PGSIZE))
+        PANIC ("zswap: corrupted page at sector %"PRDSNu, sector);
+      load_hit_cnt++;
+    }
+  else
+    load_miss_cnt++;
+  lock_release (&zswap_lock);
+  return success;
+}
+
+/* Drop the copy of the swap slot at SECTOR, the slot is free. */
+void
+zswap_invalidate (block_sector_t sector)
+{
+  struct zswap_entry *entry;
+
+  if (zswap_pages == 0)
+    return;
+
+  lock_acquire (&zswap_lock);
+  entry = zswap_find (sector);
+  if (entry != NULL)
+    zswap_remove (entry);
+  lock_release (&zswap_lock);
+}
+
+/* Find the copy of the slot at SECTOR.  zswap_lock must be held. */
+static struct zswap_entry *
+zswap_find (block_sector_t sector)
+{
+  struct zswap_entry tmp;
+  struct hash_elem *e;
+
+  tmp.sector = sector;
+  e = hash_find (&zswap_table, &tmp.elem);
+  return e ? hash_entry (e, struct zswap_entry, elem) : NULL;
+}
+
+/* Number of chunks taken by an entry of SIZE compressed bytes. */
+static size_t
+zswap_chunks (size_t size)
+{
+  return DIV_ROUND_UP (sizeof (struct zswap_entry) + size, ZSWAP_CHUNK);
+}
+
+/* Allocate an entry for SIZE compressed bytes in the arena, adding
+  a page to it if the budget allows.  Returns NULL if the arena is
+  full.  zswap_lock must be held. */
+static struct zswap_entry *
+zswap_alloc (size_t size)
+{
+  size_t cnt = zswap_chunks (size);
+  struct zswap_page *page;
+  struct list_elem *e;
+  size_t chunk;
+
+  for (e = list_begin (&zswap_arena); e != list_end (&zswap_arena);
+       e = list_next (e))
+    {
+      page = list_entry (e, struct zswap_page, elem);
+      if (page->free_cnt < cnt)
+        continue;
+      chunk = bitmap_scan_and_flip (page->used, 1, cnt, false);
+      if (chunk != BITMAP_ERROR)
+        goto found;
+    }
+
+  if (zswap_arena_cnt >= zswap_pages
+      || (page = palloc_get_page (0)) == NULL)
+    return NULL;
+  page->used = bitmap_create_in_buf (ZSWAP_CHUNK_CNT, page->used_buf,
+                                     sizeof page->used_buf);
+  bitmap_mark (page->used, 0);
+  page->free_cnt = ZSWAP_CHUNK_CNT - 1;
+  list_push_back (&zswap_arena, &page->elem);
+  zswap_arena_cnt++;
+  chunk = bitmap_scan_and_flip (page->used, 1, cnt, false);
+  ASSERT (chunk != BITMAP_ERROR);
+
+ found:
+  page->free_cnt -= cnt;
+  return (struct zswap_entry *) ((uint8_t *) page + chunk * ZSWAP_CHUNK);
+}
+
+/* Free ENTRY, and its arena page if it is empty then.  zswap_lock
+  must be held. */
+static void
+zswap_remove (struct zswap_entry *entry)
+{
+  struct zswap_page *page = pg_round_down (entry);
+  size_t chunk = ((uint8_t *) entry - (uint8_t *) page) / ZSWAP_CHUNK;
+  size_t cnt = zswap_chunks (entry->size);
+
+  hash_delete (&zswap_table, &entry->elem);
+  bitmap_set_multiple (page->used, chunk, cnt, false);
+  page->free_cnt += cnt;
+  if (page->free_cnt == ZSWAP_CHUNK_CNT - 1)
+    {
+      list_remove (&page->elem);
+      palloc_free_page (page);
+      zswap_arena_cnt--;
+    }
+}
+
+/* Compress IN_LEN bytes at IN into OUT.  Returns the compressed size,
+  or 0 if it would not fit in OUT_MAX bytes.  lz_htab is used, so
+  zswap_lock must be held. */
+static size_t
+lz_compress (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_max)
+{
+  const uint8_t *ip = in;
+  const uint8_t *in_end = in + in_len;
+  uint8_t *op = out;
+  uint8_t *out_end = out + out_max;
+  uint8_t *run;                 /* Control byte of the literal run. */
+  size_t lit = 0;               /* Length of the literal run. */
+
+  memset (lz_htab, 0, sizeof lz_htab);
+  if (op >= out_end)
+    return 0;
+  run = op++;
+
+  while (ip < in_end)
+    {
+      if (ip + 2 < in_end)
+        {
+          uint32_t v = ip[0] << 16 | ip[1] << 8 | ip[2];
+          unsigned h = (v * 2654435761u) >> (32 - LZ_HLOG);
+          const uint8_t *ref = in + lz_htab[h];
+
+          lz_htab[h] = ip - in;
+          if (ref < ip && ref[0] == ip[0] && ref[1] == ip[1] 
+              && ref[2] == ip[2])
+            {
+              size_t off = ip - ref - 1;
+              size_t max = in_end - ip < 264 ? in_end - ip : 264;
+              size_t len = 3;
+
+              while (len < max && ref[len] == ip[len])
+                len++;
+
+              /* Close the literal run, or drop its empty control. */
+              if (lit > 0)
+                *run = lit - 1;
+              else
+                op--;
+              if (op + 4 > out_end)
+                return 0;
+
+              if (len - 2 < 7)
+                *op++ = (off >> 8) | ((len - 2) << 5);
+              else
+                {
+                  *op++ = (off >> 8) | (7 << 5);
+                  *op++ = len - 2 - 7;
+                }
+              *op++ = off & 0xff;
+              ip += len;
+
+              lit = 0;
+              run = op++;
+              continue;
+            }
+        }
+
+      if (op >= out_end)
+        return 0;
+      *op++ = *ip++;
+      if (++lit == 32)
+        {
+          *run = lit - 1;
+          lit = 0;
+          if (op >= out_end)
+            return 0;
+          run = op++;
+        }
+    }
+
+  if (lit > 0)
+    *run = lit - 1;
+  else
+    op--;
+  return op - out;
+}
+
+/* Decompress IN_LEN bytes at IN into exactly OUT_LEN bytes at OUT.
+  Returns false if the data is corrupted. */
+static bool
+lz_decompress (const uint8_t *in, size_t in_len, uint8_t *out, 
+               size_t out_len)
+{
+  const uint8_t *ip = in;
+  const uint8_t *in_end = in + in_len;
+  uint8_t *op = out;
+  uint8_t *out_end = out + out_len;
+
+  while (ip < in_end)
+    {
+      size_t ctrl = *ip++;
+
+      if (ctrl < 32)
+        {
+          size_t len = ctrl + 1;
+
+          if (ip + len > in_end || op + len > out_end)
+            return false;
+          memcpy (op, ip, len);
+          ip += len;
+          op += len;
+        }
+      else
+        {
+          size_t len = ctrl >> 5;
+          size_t off = (ctrl & 0x1f) << 8;
+          const uint8_t *ref;
+
+          if (len == 7)
+            {
+              if (ip >= in_end)
+                return false;
+              len += *ip++;
+            }
+          if (ip >= in_end)
+            return false;
+          off |= *ip++;
+          len += 2;
+
+          if ((size_t) (op - out) < off + 1 || op + len > out_end)
+            return false;
+          /* Byte by byte, the reference may overlap the output. */
+          for (ref = op - off - 1; len > 0; len--)
+            *op++ = *ref++;
+        }
+    }
+
+  return op == out_end;
+}
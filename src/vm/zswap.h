@@ -0,0 +1,19 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Budget of the compressed swap cache in kernel pages, 0 if it is
+   disabled.  Controlled by kernel command-line option "-zswap". */
+extern size_t zswap_pages;
+
+void zswap_init (void);
+void zswap_print_stats (void);
+
+bool zswap_store (block_sector_t sector, const void *page);
+bool zswap_load (block_sector_t sector, void *page);
+void zswap_invalidate (block_sector_t sector);
+
+#endif